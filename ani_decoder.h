@@ -0,0 +1,274 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "pcx_decoder.h"
+
+// FreeSpace ANI animations: a palette, a list of keyframes and a stream of
+// frames. Every frame is one method byte followed by RLE data; keyframes
+// replace the whole image, the other frames only the pixels they name.
+enum ANIPackingMethod : uint8_t {
+    ANI_PACK_RLE = 0,         // delta, runs introduced by packer_code
+    ANI_PACK_RLE_KEY = 1,     // keyframe, runs introduced by packer_code
+    ANI_PACK_STD_RLE = 2,     // delta, high bit of a byte is a run count
+    ANI_PACK_STD_RLE_KEY = 3, // keyframe, high bit of a byte is a run count
+};
+
+constexpr uint8_t ANI_STD_RLE_CODE = 0x80;
+constexpr uint8_t ANI_UNCHANGED = 254; // in delta frames: keep the previous pixel
+
+struct ANIHeader {
+    int version = 0;
+    int fps = 30;
+    int width = 0;
+    int height = 0;
+    int frame_count = 0;
+    uint8_t packer_code = 0;
+    uint8_t transparent[3] = {0, 255, 0};
+    uint8_t palette[768];
+    size_t data_offset = 0; // frame data, relative to the start of the file
+    size_t data_size = 0;
+};
+
+inline ANIHeader ani_parse_header(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    auto need = [&](size_t n) {
+        if (size - pos < n)
+            throw std::runtime_error("Truncated ANI header");
+    };
+    auto u8 = [&]() { need(1); return data[pos++]; };
+    auto i16 = [&]() {
+        need(2);
+        int16_t v = static_cast<int16_t>(data[pos] | (data[pos + 1] << 8));
+        pos += 2;
+        return static_cast<int>(v);
+    };
+    auto i32 = [&]() {
+        need(4);
+        uint32_t v = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | (uint32_t(data[pos + 3]) << 24);
+        pos += 4;
+        return static_cast<int32_t>(v);
+    };
+
+    ANIHeader h;
+    h.width = i16();
+    if (h.width == 0) {
+        h.version = i16();
+        h.fps = i16();
+        if (h.version >= 2) {
+            h.transparent[0] = u8();
+            h.transparent[1] = u8();
+            h.transparent[2] = u8();
+        }
+        h.width = i16();
+    }
+    h.height = i16();
+    h.frame_count = i16();
+    h.packer_code = u8();
+    need(768);
+    std::memcpy(h.palette, data + pos, 768);
+    pos += 768;
+
+    // The keyframe table is skipped: ANIMovie indexes keyframes from the
+    // frame data itself as it decodes, which needs no trust in the table.
+    int num_keys = i16();
+    if (num_keys < 0)
+        throw std::runtime_error("Invalid ANI keyframe count");
+    need(static_cast<size_t>(num_keys) * 6);
+    pos += static_cast<size_t>(num_keys) * 6;
+
+    int compressed = i32();
+    if (h.width <= 0 || h.height <= 0 || h.frame_count <= 0 || h.fps <= 0)
+        throw std::runtime_error("Invalid ANI dimensions");
+    if (compressed < 0 || static_cast<size_t>(compressed) > size - pos)
+        throw std::runtime_error("ANI frame data runs past the end of the file");
+    h.data_offset = pos;
+    h.data_size = static_cast<size_t>(compressed);
+    return h;
+}
+
+// Like pcx_build_lut, but the transparent colour comes from the header.
+inline void ani_build_lut(const ANIHeader& h, uint32_t lut[256]) {
+    for (int i = 0; i < 256; ++i) {
+        const uint8_t* c = &h.palette[i * 3];
+        bool clear = c[0] == h.transparent[0] && c[1] == h.transparent[1] && c[2] == h.transparent[2];
+        uint8_t rgba[4] = {c[0], c[1], c[2], static_cast<uint8_t>(clear ? 0 : 255)};
+        std::memcpy(&lut[i], rgba, 4);
+    }
+}
+
+// Applies one frame to `indices` (width * height palette indices holding
+// the previous frame) and returns where the next frame starts. Runs that
+// overshoot the image are clipped.
+inline const uint8_t* ani_unpack_frame(const ANIHeader& h, const uint8_t* p, const uint8_t* end, uint8_t* indices) {
+    if (p >= end)
+        throw std::runtime_error("Unexpected end of ANI data");
+    const uint8_t method = *p++;
+    const size_t total = static_cast<size_t>(h.width) * h.height;
+    const bool key = method == ANI_PACK_RLE_KEY || method == ANI_PACK_STD_RLE_KEY;
+    size_t x = 0;
+
+    auto fill = [&](uint8_t value, size_t count) {
+        count = std::min(count, total - x);
+        if (key || value != ANI_UNCHANGED)
+            std::memset(indices + x, value, count);
+        x += count;
+    };
+    auto next = [&]() {
+        if (p >= end)
+            throw std::runtime_error("Unexpected end of ANI data");
+        return *p++;
+    };
+
+    switch (method) {
+    case ANI_PACK_RLE:
+    case ANI_PACK_RLE_KEY:
+        while (x < total) {
+            uint8_t value = next();
+            if (value != h.packer_code) {
+                fill(value, 1);
+                continue;
+            }
+            // Both forms write count + 1 pixels; below 2 the run is of
+            // packer_code itself rather than of a following byte.
+            uint8_t count = next();
+            fill(count < 2 ? value : next(), size_t(count) + 1);
+        }
+        break;
+    case ANI_PACK_STD_RLE:
+    case ANI_PACK_STD_RLE_KEY:
+        while (x < total) {
+            uint8_t value = next();
+            if (value & ANI_STD_RLE_CODE)
+                fill(next(), value & ~ANI_STD_RLE_CODE);
+            else
+                fill(value, 1);
+        }
+        break;
+    default:
+        throw std::runtime_error("Unknown ANI packing method");
+    }
+    return p;
+}
+
+// Decodes an animation into a small ring of RGBA frames. Frames are decoded
+// in order as they are asked for, and only `ring_size` of them exist at
+// once, so memory stays the same however long the animation is. Keyframes
+// are noted as they are decoded; asking for a frame that has already left
+// the ring resumes from the nearest keyframe before it.
+class ANIMovie {
+public:
+    // Copies the file; `data` need not outlive the movie.
+    void load(const uint8_t* data, size_t size, int ring_size = 8) {
+        m_header = ani_parse_header(data, size);
+        m_data.assign(data + m_header.data_offset, data + m_header.data_offset + m_header.data_size);
+        ani_build_lut(m_header, m_lut);
+
+        m_ring_size = std::max(2, std::min(ring_size, m_header.frame_count));
+        m_ring.assign(frame_bytes() * m_ring_size, 0);
+        m_ring_frame.assign(m_ring_size, -1);
+        m_keyframes.clear();
+        rewind();
+    }
+
+    const ANIHeader& header() const { return m_header; }
+    int width() const { return m_header.width; }
+    int height() const { return m_header.height; }
+    int fps() const { return m_header.fps; }
+    int frame_count() const { return m_header.frame_count; }
+    int ring_size() const { return m_ring_size; }
+    size_t stride() const { return static_cast<size_t>(m_header.width) * 4; }
+    size_t frame_bytes() const { return stride() * m_header.height; }
+
+    // Ring storage never moves after load(), so callers may wrap a slot
+    // (e.g. in a Gdk::Pixbuf) for as long as the movie stays loaded.
+    uint8_t* slot_pixels(int slot) { return m_ring.data() + frame_bytes() * slot; }
+    int slot_of(int frame) const { return frame % m_ring_size; }
+
+    // Returns frame `n` as RGBA rows of stride() bytes. The pointer stays
+    // valid until a frame ring_size() or more later is decoded.
+    const uint8_t* frame(int n) {
+        n = ((n % frame_count()) + frame_count()) % frame_count();
+        if (m_ring_frame[slot_of(n)] != n) {
+            seek(n);
+            while (m_next <= n)
+                decode_next(n);
+        }
+        return slot_pixels(slot_of(n));
+    }
+
+    // Decodes the frames following `n` into the ring, leaving `n` in place.
+    void decode_ahead(int n) {
+        frame(n);
+        n = ((n % frame_count()) + frame_count()) % frame_count();
+        int last = std::min(n + m_ring_size - 1, frame_count() - 1);
+        while (m_next <= last)
+            decode_next(n + 1);
+    }
+
+    size_t memory_usage() const {
+        return sizeof(*this) + m_data.capacity() + m_indices.capacity() + m_ring.capacity() +
+               m_ring_frame.capacity() * sizeof(int) + m_keyframes.capacity() * sizeof(ANIKeyframe);
+    }
+
+private:
+    struct ANIKeyframe {
+        int frame;
+        size_t offset; // into m_data
+    };
+
+    void rewind() {
+        m_pos = m_data.data();
+        m_next = 0;
+        m_indices.assign(static_cast<size_t>(m_header.width) * m_header.height, 0);
+        std::fill(m_ring_frame.begin(), m_ring_frame.end(), -1);
+    }
+
+    // Positions decoding so frame `n` comes next or later: jumps to the last
+    // known keyframe at or before `n` when that is behind us or ahead of
+    // m_next, and otherwise rewinds only if `n` has already been passed.
+    // A keyframe replaces every index, so none of the skipped state matters.
+    void seek(int n) {
+        auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), n,
+                                   [](int f, const ANIKeyframe& k) { return f < k.frame; });
+        if (it != m_keyframes.begin()) {
+            const ANIKeyframe& key = *std::prev(it);
+            if (n < m_next || key.frame > m_next) {
+                m_pos = m_data.data() + key.offset;
+                m_next = key.frame;
+                std::fill(m_ring_frame.begin(), m_ring_frame.end(), -1);
+            }
+        } else if (n < m_next) {
+            rewind();
+        }
+    }
+
+    // Unpacks frame m_next; only frames from `keep_from` on are expanded
+    // into the ring, the ones before are merely stepped over.
+    void decode_next(int keep_from) {
+        if (m_pos < m_data.data() + m_data.size() &&
+            (*m_pos == ANI_PACK_RLE_KEY || *m_pos == ANI_PACK_STD_RLE_KEY) &&
+            (m_keyframes.empty() || m_keyframes.back().frame < m_next))
+            m_keyframes.push_back({m_next, static_cast<size_t>(m_pos - m_data.data())});
+        m_pos = ani_unpack_frame(m_header, m_pos, m_data.data() + m_data.size(), m_indices.data());
+        if (m_next >= keep_from) {
+            int slot = slot_of(m_next);
+            pcx_expand(m_indices.data(), slot_pixels(slot), m_header.width * m_header.height, m_lut);
+            m_ring_frame[slot] = m_next;
+        }
+        ++m_next;
+    }
+
+    ANIHeader m_header;
+    std::vector<uint8_t> m_data;    // compressed frames
+    std::vector<uint8_t> m_indices; // palette indices of frame m_next - 1
+    std::vector<uint8_t> m_ring;    // m_ring_size RGBA frames
+    std::vector<int> m_ring_frame;  // frame held by each slot, or -1
+    std::vector<ANIKeyframe> m_keyframes; // seen so far, by frame
+    const uint8_t* m_pos = nullptr; // start of frame m_next in m_data
+    int m_next = 0;
+    int m_ring_size = 0;
+    uint32_t m_lut[256];
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include "vp_parser.h"
+#include "vp_trace.h"
+
+// One long-lived appsrc ! decodebin ! audioconvert ! autoaudiosink pipeline.
+// The source is fed on demand from the archive: straight out of the mapping
+// with gst_buffer_new_wrapped_full when there is one, otherwise in bounded
+// pread chunks. Switching to another entry only re-points the source.
+class AudioPlayer {
+public:
+    AudioPlayer() {
+        VPTraceScope trace("AudioPlayer pipeline");
+        m_pipeline = gst_pipeline_new("vp-pipeline");
+        m_appsrc = gst_element_factory_make("appsrc", "source");
+        GstElement* decodebin = gst_element_factory_make("decodebin", "decode");
+        m_convert = gst_element_factory_make("audioconvert", "convert");
+        GstElement* sink = gst_element_factory_make("autoaudiosink", "sink");
+
+        if (!m_pipeline || !m_appsrc || !decodebin || !m_convert || !sink) {
+            std::cerr << "Failed to create one or more GStreamer elements." << std::endl;
+            for (GstElement* e : {m_pipeline, m_appsrc, decodebin, m_convert, sink})
+                if (e) gst_object_unref(e);
+            m_pipeline = nullptr;
+            return;
+        }
+
+        gst_bin_add_many(GST_BIN(m_pipeline), m_appsrc, decodebin, m_convert, sink, nullptr);
+        gst_element_link(m_appsrc, decodebin);
+        g_signal_connect(decodebin, "pad-added", G_CALLBACK(on_pad_added), m_convert);
+        gst_element_link(m_convert, sink);
+
+        GstAppSrc* appsrc = GST_APP_SRC(m_appsrc);
+        gst_app_src_set_stream_type(appsrc, GST_APP_STREAM_TYPE_SEEKABLE);
+        GstCaps* caps = gst_caps_new_empty_simple("audio/x-wav");
+        gst_app_src_set_caps(appsrc, caps);
+        gst_caps_unref(caps);
+
+        GstAppSrcCallbacks callbacks = {};
+        callbacks.need_data = on_need_data;
+        callbacks.seek_data = on_seek_data;
+        gst_app_src_set_callbacks(appsrc, &callbacks, this, nullptr);
+
+        GstBus* bus = gst_element_get_bus(m_pipeline);
+        m_bus_watch = gst_bus_add_watch(bus, on_bus_message, this);
+        gst_object_unref(bus);
+    }
+
+    ~AudioPlayer() {
+        if (m_bus_watch)
+            g_source_remove(m_bus_watch);
+        if (m_pipeline) {
+            gst_element_set_state(m_pipeline, GST_STATE_NULL);
+            gst_object_unref(m_pipeline);
+        }
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    AudioPlayer(const AudioPlayer&) = delete;
+    AudioPlayer& operator=(const AudioPlayer&) = delete;
+
+    bool ok() const { return m_pipeline != nullptr; }
+
+    // Points the source at `entry`; the next play() starts it from the top.
+    // Holds its own reference to the mapping (or a dup of the fd), so the
+    // archive may be closed while this entry is still playing.
+    bool set_source(const VPParser& parser, const VPEntry& entry) {
+        if (!m_pipeline || !parser.in_bounds(entry)) return false;
+        VPTraceScope trace("AudioPlayer::set_source");
+        trace.set_bytes(entry.size);
+        trace.set_detail(entry.full_path);
+        gst_element_set_state(m_pipeline, GST_STATE_READY);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd = -1;
+        m_map = parser.mapping();
+        if (!m_map)
+            m_fd = dup(parser.fd());
+        m_base = static_cast<uint64_t>(entry.offset);
+        m_size = static_cast<uint64_t>(entry.size);
+        m_pos = 0;
+        gst_app_src_set_size(GST_APP_SRC(m_appsrc), static_cast<gint64>(m_size));
+        return true;
+    }
+
+    void play() {
+        if (!m_pipeline) return;
+        VPTraceScope trace("AudioPlayer::play");
+        gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+    }
+    void pause() { if (m_pipeline) gst_element_set_state(m_pipeline, GST_STATE_PAUSED); }
+    void stop() {
+        if (!m_pipeline) return;
+        gst_element_set_state(m_pipeline, GST_STATE_READY);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pos = 0;
+    }
+
+    void restart() {
+        stop();
+        play();
+    }
+
+    bool query(double& position, double& duration) const {
+        if (!m_pipeline) return false;
+        gint64 pos = 0, dur = 0;
+        if (!gst_element_query_position(m_pipeline, GST_FORMAT_TIME, &pos) ||
+            !gst_element_query_duration(m_pipeline, GST_FORMAT_TIME, &dur))
+            return false;
+        position = static_cast<double>(pos) / GST_SECOND;
+        duration = static_cast<double>(dur) / GST_SECOND;
+        return true;
+    }
+
+private:
+    static constexpr guint chunk_size = 64 * 1024;
+
+    // Streaming thread: push the next chunk of the entry, or end the stream.
+    // `length` is only a hint (and often -1), so chunks are a fixed size.
+    static void on_need_data(GstAppSrc* src, guint, gpointer data) {
+        auto* self = static_cast<AudioPlayer*>(data);
+        GstBuffer* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(self->m_mutex);
+            uint64_t remaining = self->m_size - std::min(self->m_pos, self->m_size);
+            if (remaining > 0) {
+                gsize n = static_cast<gsize>(std::min<uint64_t>(remaining, chunk_size));
+                buffer = self->m_map ? self->wrap_mapped(n) : self->read_chunk(n);
+                if (buffer) {
+                    GST_BUFFER_OFFSET(buffer) = self->m_pos;
+                    self->m_pos += n;
+                }
+            }
+        }
+        if (buffer)
+            gst_app_src_push_buffer(src, buffer);
+        else
+            gst_app_src_end_of_stream(src);
+    }
+
+    // Main loop: a finished or failed stream goes back to READY, so the
+    // next play() starts the same entry from the top again.
+    static gboolean on_bus_message(GstBus*, GstMessage* message, gpointer data) {
+        auto* self = static_cast<AudioPlayer*>(data);
+        switch (GST_MESSAGE_TYPE(message)) {
+        case GST_MESSAGE_EOS:
+            self->stop();
+            break;
+        case GST_MESSAGE_ERROR: {
+            GError* error = nullptr;
+            gchar* debug = nullptr;
+            gst_message_parse_error(message, &error, &debug);
+            std::cerr << "GStreamer error: " << (error ? error->message : "unknown");
+            if (debug) std::cerr << " (" << debug << ")";
+            std::cerr << std::endl;
+            g_clear_error(&error);
+            g_free(debug);
+            self->stop();
+            break;
+        }
+        default:
+            break;
+        }
+        return TRUE;
+    }
+
+    static gboolean on_seek_data(GstAppSrc*, guint64 offset, gpointer data) {
+        auto* self = static_cast<AudioPlayer*>(data);
+        std::lock_guard<std::mutex> lock(self->m_mutex);
+        if (offset > self->m_size) return FALSE;
+        self->m_pos = offset;
+        return TRUE;
+    }
+
+    // Zero-copy: the buffer points into the mapping and holds a reference
+    // to it until GStreamer is done with the memory.
+    GstBuffer* wrap_mapped(gsize n) {
+        auto* keep = new std::shared_ptr<const VPMapping>(m_map);
+        auto* p = const_cast<uint8_t*>(m_map->data() + m_base + m_pos);
+        return gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, p, n, 0, n, keep, [](gpointer k) {
+            delete static_cast<std::shared_ptr<const VPMapping>*>(k);
+        });
+    }
+
+    GstBuffer* read_chunk(gsize n) {
+        GstBuffer* buffer = gst_buffer_new_allocate(nullptr, n, nullptr);
+        GstMapInfo info;
+        gst_buffer_map(buffer, &info, GST_MAP_WRITE);
+        ssize_t got = pread(m_fd, info.data, n, static_cast<off_t>(m_base + m_pos));
+        gst_buffer_unmap(buffer, &info);
+        if (got != static_cast<ssize_t>(n)) {
+            gst_buffer_unref(buffer);
+            return nullptr;
+        }
+        return buffer;
+    }
+
+    static void on_pad_added(GstElement*, GstPad* pad, gpointer data) {
+        GstElement* convert = static_cast<GstElement*>(data);
+        GstPad* sinkpad = gst_element_get_static_pad(convert, "sink");
+        if (!gst_pad_is_linked(sinkpad) && gst_pad_link(pad, sinkpad) != GST_PAD_LINK_OK)
+            std::cerr << "Failed to link decodebin to audioconvert" << std::endl;
+        gst_object_unref(sinkpad);
+    }
+
+    GstElement* m_pipeline = nullptr;
+    GstElement* m_appsrc = nullptr;
+    GstElement* m_convert = nullptr;
+    guint m_bus_watch = 0;
+
+    std::mutex m_mutex; // guards the source fields below against the streaming thread
+    std::shared_ptr<const VPMapping> m_map;
+    int m_fd = -1;
+    uint64_t m_base = 0;
+    uint64_t m_size = 0;
+    uint64_t m_pos = 0;
+};
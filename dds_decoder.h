@@ -0,0 +1,370 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+// DirectDraw Surface textures: BC1/BC2/BC3 (DXT1/DXT3/DXT5, also through
+// the DX10 header) and uncompressed formats described by bit masks. Output
+// is RGBA in memory order, like pcx_decoder.h.
+
+enum class DDSFormat { BC1, BC2, BC3, Uncompressed };
+
+struct DDSInfo {
+    int width = 0;
+    int height = 0;
+    int mip_count = 1; // levels actually present in the file
+    DDSFormat format = DDSFormat::BC1;
+    int bits_per_pixel = 0;        // uncompressed only
+    uint32_t masks[4] = {0, 0, 0, 0}; // r, g, b, a; uncompressed only
+    bool luminance = false;        // uncompressed: r mask is grey
+    size_t data_offset = 0;
+};
+
+struct DDSImage {
+    int width;
+    int height;
+    std::vector<uint8_t> rgba_data;
+};
+
+inline int dds_level_width(const DDSInfo& info, int level) { return std::max(1, info.width >> level); }
+inline int dds_level_height(const DDSInfo& info, int level) { return std::max(1, info.height >> level); }
+
+inline size_t dds_level_size(const DDSInfo& info, int level) {
+    size_t w = dds_level_width(info, level), h = dds_level_height(info, level);
+    if (info.format == DDSFormat::Uncompressed)
+        return (w * info.bits_per_pixel + 7) / 8 * h;
+    size_t block_bytes = info.format == DDSFormat::BC1 ? 8 : 16;
+    return ((w + 3) / 4) * ((h + 3) / 4) * block_bytes;
+}
+
+inline size_t dds_level_offset(const DDSInfo& info, int level) {
+    size_t offset = info.data_offset;
+    for (int i = 0; i < level; ++i)
+        offset += dds_level_size(info, i);
+    return offset;
+}
+
+inline DDSInfo dds_parse(const uint8_t* data, size_t size) {
+    if (size < 128 || std::memcmp(data, "DDS ", 4) != 0)
+        throw std::runtime_error("Not a DDS file");
+    auto u32 = [&](size_t offset) {
+        uint32_t v;
+        std::memcpy(&v, data + offset, 4);
+        return v;
+    };
+
+    DDSInfo info;
+    info.height = static_cast<int>(u32(12));
+    info.width = static_cast<int>(u32(16));
+    uint32_t mips = u32(28);
+    uint32_t pf_flags = u32(80);
+    const uint8_t* fourcc = data + 84;
+    info.data_offset = 128;
+    if (info.width <= 0 || info.height <= 0 || info.width > 16384 || info.height > 16384)
+        throw std::runtime_error("Invalid DDS dimensions");
+
+    const uint32_t DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40, DDPF_LUMINANCE = 0x20000;
+    auto set_masks = [&](int bpp, uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        info.format = DDSFormat::Uncompressed;
+        info.bits_per_pixel = bpp;
+        info.masks[0] = r; info.masks[1] = g; info.masks[2] = b; info.masks[3] = a;
+    };
+
+    if (pf_flags & DDPF_FOURCC) {
+        if (!std::memcmp(fourcc, "DXT1", 4)) info.format = DDSFormat::BC1;
+        else if (!std::memcmp(fourcc, "DXT2", 4) || !std::memcmp(fourcc, "DXT3", 4)) info.format = DDSFormat::BC2;
+        else if (!std::memcmp(fourcc, "DXT4", 4) || !std::memcmp(fourcc, "DXT5", 4)) info.format = DDSFormat::BC3;
+        else if (!std::memcmp(fourcc, "DX10", 4)) {
+            if (size < 148) throw std::runtime_error("Truncated DDS DX10 header");
+            info.data_offset = 148;
+            switch (u32(128)) { // DXGI_FORMAT
+            case 71: case 72: info.format = DDSFormat::BC1; break;
+            case 74: case 75: info.format = DDSFormat::BC2; break;
+            case 77: case 78: info.format = DDSFormat::BC3; break;
+            case 28: case 29: set_masks(32, 0xFF, 0xFF00, 0xFF0000, 0xFF000000); break;
+            case 87: case 91: set_masks(32, 0xFF0000, 0xFF00, 0xFF, 0xFF000000); break;
+            default: throw std::runtime_error("Unsupported DDS DXGI format");
+            }
+        } else {
+            throw std::runtime_error("Unsupported DDS compression");
+        }
+    } else if (pf_flags & (DDPF_RGB | DDPF_LUMINANCE)) {
+        int bpp = static_cast<int>(u32(88));
+        if (bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)
+            throw std::runtime_error("Unsupported DDS bit depth");
+        set_masks(bpp, u32(92), u32(96), u32(100), (pf_flags & DDPF_ALPHAPIXELS) ? u32(104) : 0);
+        info.luminance = (pf_flags & DDPF_LUMINANCE) != 0;
+    } else {
+        throw std::runtime_error("Unsupported DDS pixel format");
+    }
+
+    // Only count the levels that are really there.
+    int wanted = std::max<uint32_t>(1, std::min<uint32_t>(mips, 32));
+    info.mip_count = 0;
+    size_t offset = info.data_offset;
+    while (info.mip_count < wanted) {
+        size_t level_size = dds_level_size(info, info.mip_count);
+        if (offset > size || size - offset < level_size) break;
+        offset += level_size;
+        ++info.mip_count;
+        if (dds_level_width(info, info.mip_count - 1) == 1 && dds_level_height(info, info.mip_count - 1) == 1) break;
+    }
+    if (info.mip_count == 0)
+        throw std::runtime_error("DDS data runs past the end of the file");
+    return info;
+}
+
+// The smallest level that still covers the image as shown fitted into
+// target_w x target_h (aspect preserved), so a preview never decodes more
+// pixels than it can show. Level 0 if the fitted size is not smaller.
+inline int dds_pick_level(const DDSInfo& info, int target_w, int target_h) {
+    if (target_w <= 0 || target_h <= 0) return 0;
+    double fit = std::min(static_cast<double>(target_w) / info.width, static_cast<double>(target_h) / info.height);
+    if (fit >= 1.0) return 0;
+    double shown_w = std::ceil(info.width * fit), shown_h = std::ceil(info.height * fit);
+    int level = 0;
+    for (int i = 1; i < info.mip_count; ++i) {
+        if (dds_level_width(info, i) < shown_w || dds_level_height(info, i) < shown_h) break;
+        level = i;
+    }
+    return level;
+}
+
+// ---- 4x4 block kernels ----------------------------------------------------
+
+inline uint32_t dds_rgba(int r, int g, int b, int a) {
+    uint8_t px[4] = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b), static_cast<uint8_t>(a)};
+    uint32_t v;
+    std::memcpy(&v, px, 4);
+    return v;
+}
+
+// The four colours of a BC1-style block; `bc1` allows the three-colour
+// mode whose fourth entry is transparent black.
+inline void dds_colour_palette(const uint8_t* block, bool bc1, uint32_t pal[4]) {
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    int r0 = (c0 >> 11) & 31, g0 = (c0 >> 5) & 63, b0 = c0 & 31;
+    int r1 = (c1 >> 11) & 31, g1 = (c1 >> 5) & 63, b1 = c1 & 31;
+    r0 = (r0 << 3) | (r0 >> 2); g0 = (g0 << 2) | (g0 >> 4); b0 = (b0 << 3) | (b0 >> 2);
+    r1 = (r1 << 3) | (r1 >> 2); g1 = (g1 << 2) | (g1 >> 4); b1 = (b1 << 3) | (b1 >> 2);
+    pal[0] = dds_rgba(r0, g0, b0, 255);
+    pal[1] = dds_rgba(r1, g1, b1, 255);
+    if (c0 > c1 || !bc1) {
+        pal[2] = dds_rgba((2 * r0 + r1) / 3, (2 * g0 + g1) / 3, (2 * b0 + b1) / 3, 255);
+        pal[3] = dds_rgba((r0 + 2 * r1) / 3, (g0 + 2 * g1) / 3, (b0 + 2 * b1) / 3, 255);
+    } else {
+        pal[2] = dds_rgba((r0 + r1) / 2, (g0 + g1) / 2, (b0 + b1) / 2, 255);
+        pal[3] = dds_rgba(0, 0, 0, 0);
+    }
+}
+
+// Sixteen alpha values of a BC2 (explicit 4-bit) or BC3 (interpolated) block.
+inline void dds_alpha_values(const uint8_t* block, DDSFormat format, uint8_t alpha[16]) {
+    if (format == DDSFormat::BC2) {
+        for (int i = 0; i < 16; ++i) {
+            int a = (block[i / 2] >> ((i & 1) * 4)) & 0xF;
+            alpha[i] = static_cast<uint8_t>(a * 17);
+        }
+        return;
+    }
+    int a0 = block[0], a1 = block[1];
+    uint8_t pal[8] = {static_cast<uint8_t>(a0), static_cast<uint8_t>(a1)};
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) pal[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+    } else {
+        for (int i = 1; i < 5; ++i) pal[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) bits |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i) alpha[i] = pal[(bits >> (3 * i)) & 7];
+}
+
+// Writes one decoded block: pixel (x, y) is pal[(bits >> 2 * (4y + x)) & 3],
+// with its alpha replaced from `alpha` when there is one.
+inline void dds_write_block_scalar(const uint32_t pal[4], uint32_t bits, const uint8_t* alpha,
+                                   uint8_t* dst, size_t stride) {
+    for (int y = 0; y < 4; ++y) {
+        uint8_t* row = dst + stride * y;
+        for (int x = 0; x < 4; ++x) {
+            std::memcpy(row + x * 4, &pal[(bits >> (2 * (4 * y + x))) & 3], 4);
+            if (alpha) row[x * 4 + 3] = alpha[4 * y + x];
+        }
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// pshufb controls: a row's index byte -> the palette bytes of its four
+// pixels, and a row number -> that row's four alpha bytes moved to byte 3.
+struct DDSShuffleTables {
+    alignas(16) uint8_t colour[256][16];
+    alignas(16) uint8_t alpha[4][16];
+
+    DDSShuffleTables() {
+        for (int b = 0; b < 256; ++b)
+            for (int x = 0; x < 4; ++x)
+                for (int k = 0; k < 4; ++k)
+                    colour[b][4 * x + k] = static_cast<uint8_t>(((b >> (2 * x)) & 3) * 4 + k);
+        for (int y = 0; y < 4; ++y)
+            for (int i = 0; i < 16; ++i)
+                alpha[y][i] = (i & 3) == 3 ? static_cast<uint8_t>(4 * y + i / 4) : 0x80;
+    }
+};
+
+inline const DDSShuffleTables& dds_shuffle_tables() {
+    static const DDSShuffleTables tables;
+    return tables;
+}
+
+// One pshufb per row picks the four palette entries; BC2/BC3 alpha is
+// shuffled into byte 3 of each pixel with a second one.
+__attribute__((target("ssse3")))
+inline void dds_write_block_ssse3(const uint32_t pal[4], uint32_t bits, const uint8_t* alpha,
+                                  uint8_t* dst, size_t stride) {
+    const DDSShuffleTables& t = dds_shuffle_tables();
+    __m128i palette = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pal));
+    __m128i a16 = alpha ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha)) : _mm_setzero_si128();
+    const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+    for (int y = 0; y < 4; ++y) {
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(t.colour[(bits >> (8 * y)) & 0xFF]));
+        __m128i px = _mm_shuffle_epi8(palette, ctrl);
+        if (alpha) {
+            __m128i actrl = _mm_load_si128(reinterpret_cast<const __m128i*>(t.alpha[y]));
+            px = _mm_or_si128(_mm_and_si128(px, rgb_mask), _mm_shuffle_epi8(a16, actrl));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + stride * y), px);
+    }
+}
+#endif
+
+inline void dds_write_block(const uint32_t pal[4], uint32_t bits, const uint8_t* alpha, uint8_t* dst, size_t stride) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        dds_write_block_ssse3(pal, bits, alpha, dst, stride);
+        return;
+    }
+#endif
+    dds_write_block_scalar(pal, bits, alpha, dst, stride);
+}
+
+// Decodes block rows [row_begin, row_end) of a BCn level.
+inline void dds_decode_block_rows(const DDSInfo& info, const uint8_t* src, int width, int height,
+                                  int row_begin, int row_end, uint8_t* dst, size_t stride) {
+    const int blocks_x = (width + 3) / 4;
+    const size_t block_bytes = info.format == DDSFormat::BC1 ? 8 : 16;
+    const size_t colour_at = info.format == DDSFormat::BC1 ? 0 : 8;
+    uint8_t alpha[16];
+    uint8_t partial[4 * 16];
+    for (int by = row_begin; by < row_end; ++by) {
+        const uint8_t* block = src + static_cast<size_t>(by) * blocks_x * block_bytes;
+        for (int bx = 0; bx < blocks_x; ++bx, block += block_bytes) {
+            uint32_t pal[4];
+            dds_colour_palette(block + colour_at, info.format == DDSFormat::BC1, pal);
+            uint32_t bits;
+            std::memcpy(&bits, block + colour_at + 4, 4);
+            const uint8_t* a = nullptr;
+            if (info.format != DDSFormat::BC1) {
+                dds_alpha_values(block, info.format, alpha);
+                a = alpha;
+            }
+
+            int x = bx * 4, y = by * 4;
+            uint8_t* out = dst + stride * y + static_cast<size_t>(x) * 4;
+            if (x + 4 <= width && y + 4 <= height) {
+                dds_write_block(pal, bits, a, out, stride);
+            } else { // edge block: decode aside, copy what is inside the image
+                dds_write_block(pal, bits, a, partial, 16);
+                int w = std::min(4, width - x), h = std::min(4, height - y);
+                for (int r = 0; r < h; ++r)
+                    std::memcpy(out + stride * r, partial + 16 * r, static_cast<size_t>(w) * 4);
+            }
+        }
+    }
+}
+
+inline void dds_decode_rows_uncompressed(const DDSInfo& info, const uint8_t* src, int width,
+                                         int row_begin, int row_end, uint8_t* dst, size_t stride) {
+    int shift[4], bits[4];
+    for (int c = 0; c < 4; ++c) {
+        uint32_t m = info.masks[c];
+        shift[c] = m ? __builtin_ctz(m) : 0;
+        bits[c] = __builtin_popcount(m);
+    }
+    auto channel = [&](uint32_t v, int c) -> int {
+        if (!bits[c]) return c == 3 ? 255 : 0;
+        uint32_t raw = (v & info.masks[c]) >> shift[c];
+        uint32_t max = bits[c] >= 32 ? 0xFFFFFFFFu : (1u << bits[c]) - 1;
+        return static_cast<int>((static_cast<uint64_t>(raw) * 255 + max / 2) / max);
+    };
+    const int bytes = info.bits_per_pixel / 8;
+    const size_t pitch = (static_cast<size_t>(width) * info.bits_per_pixel + 7) / 8;
+    for (int y = row_begin; y < row_end; ++y) {
+        const uint8_t* in = src + pitch * y;
+        uint8_t* out = dst + stride * y;
+        for (int x = 0; x < width; ++x, in += bytes, out += 4) {
+            uint32_t v = 0;
+            std::memcpy(&v, in, bytes);
+            int r = channel(v, 0);
+            int g = info.luminance ? r : channel(v, 1);
+            int b = info.luminance ? r : channel(v, 2);
+            uint32_t px = dds_rgba(r, g, b, channel(v, 3));
+            std::memcpy(out, &px, 4);
+        }
+    }
+}
+
+// Decodes mip `level` into `dst`: rows of dds_level_width() RGBA pixels,
+// `stride` bytes apart. Large levels are split by block rows over up to
+// `threads` threads (0 picks from the hardware).
+inline void decode_dds_into(const DDSInfo& info, const uint8_t* data, size_t size, int level,
+                            uint8_t* dst, size_t stride, unsigned threads = 0) {
+    if (level < 0 || level >= info.mip_count)
+        throw std::runtime_error("DDS mip level out of range");
+    const size_t offset = dds_level_offset(info, level);
+    if (offset > size || size - offset < dds_level_size(info, level))
+        throw std::runtime_error("DDS data runs past the end of the file");
+    const uint8_t* src = data + offset;
+    const int width = dds_level_width(info, level), height = dds_level_height(info, level);
+    const bool compressed = info.format != DDSFormat::Uncompressed;
+    const int rows = compressed ? (height + 3) / 4 : height;
+
+    auto work = [&](int begin, int end) {
+        if (compressed)
+            dds_decode_block_rows(info, src, width, height, begin, end, dst, stride);
+        else
+            dds_decode_rows_uncompressed(info, src, width, begin, end, dst, stride);
+    };
+
+    // Below ~256K pixels a thread costs more than it saves.
+    if (threads == 0)
+        threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+    if (static_cast<size_t>(width) * height < (1u << 18))
+        threads = 1;
+    threads = std::min(threads, static_cast<unsigned>(rows));
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(work, static_cast<int>(rows * t / threads), static_cast<int>(rows * (t + 1) / threads));
+    work(0, static_cast<int>(rows / threads));
+    for (auto& th : pool) th.join();
+}
+
+inline DDSImage load_dds_from_memory(const uint8_t* data, size_t size, int level = 0) {
+    DDSInfo info = dds_parse(data, size);
+    DDSImage image;
+    image.width = dds_level_width(info, level);
+    image.height = dds_level_height(info, level);
+    image.rgba_data.resize(static_cast<size_t>(image.width) * image.height * 4);
+    decode_dds_into(info, data, size, level, image.rgba_data.data(), static_cast<size_t>(image.width) * 4);
+    return image;
+}
@@ -0,0 +1,7 @@
+#include "vp_verify.h"
+#include <cstdio>
+int main(){ const char* s="123456789"; printf("%08x %08x\n", crc32c(0,(const uint8_t*)s,9), crc32c_table(0,(const uint8_t*)s,9));
+ XXH64 h; printf("%016llx\n",(unsigned long long)h.digest());
+ XXH64 a; a.update((const uint8_t*)"a",1); printf("%016llx\n",(unsigned long long)a.digest());
+ std::string big(100,'x'); XXH64 b; b.update((const uint8_t*)big.data(),33); b.update((const uint8_t*)big.data()+33,67); printf("%016llx\n",(unsigned long long)b.digest());
+ XXH64 c; c.update((const uint8_t*)big.data(),100); printf("%016llx\n",(unsigned long long)c.digest());}
@@ -0,0 +1,199 @@
+#pragma once
+#include <gtkmm.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Converts RGB or RGBA rows (straight alpha, memory order, as decoders and
+// Gdk::Pixbuf produce them) to Cairo's premultiplied native-endian ARGB32.
+inline void rgba_to_cairo(const uint8_t* src, size_t src_stride, int channels,
+                          uint8_t* dst, size_t dst_stride, int width, int height) {
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* in = src + src_stride * y;
+        uint32_t* out = reinterpret_cast<uint32_t*>(dst + dst_stride * y);
+        for (int x = 0; x < width; ++x, in += channels) {
+            uint32_t r = in[0], g = in[1], b = in[2], a = channels == 4 ? in[3] : 255;
+            if (a == 255) {
+                out[x] = 0xFF000000u | (r << 16) | (g << 8) | b;
+            } else if (a == 0) {
+                out[x] = 0;
+            } else {
+                r = (r * a + 127) / 255;
+                g = (g * a + 127) / 255;
+                b = (b * a + 127) / 255;
+                out[x] = (a << 24) | (r << 16) | (g << 8) | b;
+            }
+        }
+    }
+}
+
+// Half-size copy of an ARGB32 surface, averaging 2x2 blocks. Averaging is
+// exact on premultiplied pixels; odd edges repeat the last row or column.
+inline Cairo::RefPtr<Cairo::ImageSurface> downscale_half(const Cairo::RefPtr<Cairo::ImageSurface>& src) {
+    const int sw = src->get_width(), sh = src->get_height();
+    const int dw = std::max(1, sw / 2), dh = std::max(1, sh / 2);
+    auto dst = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, dw, dh);
+    src->flush();
+    const uint8_t* in = src->get_data();
+    uint8_t* out = dst->get_data();
+    const int in_stride = src->get_stride(), out_stride = dst->get_stride();
+    for (int y = 0; y < dh; ++y) {
+        const uint32_t* r0 = reinterpret_cast<const uint32_t*>(in + in_stride * std::min(2 * y, sh - 1));
+        const uint32_t* r1 = reinterpret_cast<const uint32_t*>(in + in_stride * std::min(2 * y + 1, sh - 1));
+        uint32_t* o = reinterpret_cast<uint32_t*>(out + out_stride * y);
+        for (int x = 0; x < dw; ++x) {
+            int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+            uint32_t p[4] = {r0[x0], r0[x1], r1[x0], r1[x1]};
+            uint32_t v = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2;
+                for (uint32_t q : p) sum += (q >> shift) & 0xFF;
+                v |= (sum / 4) << shift;
+            }
+            o[x] = v;
+        }
+    }
+    dst->mark_dirty();
+    return dst;
+}
+
+// The one widget every decoded image is shown in. The image is kept as a
+// premultiplied Cairo surface, so a redraw is a single paint of it (or of a
+// cached half-size copy when zoomed out) whatever was shown before.
+//
+// Starts scaled to fit (never enlarged); scroll zooms about the pointer,
+// dragging pans, and a double-click goes back to fitting.
+class ImageView : public Gtk::DrawingArea {
+public:
+    ImageView() {
+        add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON1_MOTION_MASK | Gdk::SCROLL_MASK);
+    }
+
+    void set_pixbuf(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+        if (!pixbuf) {
+            clear();
+            return;
+        }
+        set_rgba(pixbuf->get_pixels(), pixbuf->get_width(), pixbuf->get_height(), pixbuf->get_rowstride(),
+                 pixbuf->get_n_channels(), false);
+    }
+
+    // Copies `width` x `height` pixels of 3 or 4 channels. With keep_view
+    // (e.g. the next frame of an animation of the same size) the zoom and
+    // pan stay and the surface is reused.
+    void set_rgba(const uint8_t* data, int width, int height, size_t stride, int channels, bool keep_view) {
+        bool reuse = keep_view && !m_levels.empty() && m_levels[0]->get_width() == width &&
+                     m_levels[0]->get_height() == height;
+        if (!reuse) {
+            m_levels.assign(1, Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height));
+            m_fit = true;
+            m_center_x = width / 2.0;
+            m_center_y = height / 2.0;
+        } else {
+            m_levels.resize(1);
+        }
+        const auto& surface = m_levels[0];
+        surface->flush();
+        rgba_to_cairo(data, stride, channels, surface->get_data(), surface->get_stride(), width, height);
+        surface->mark_dirty();
+        queue_draw();
+    }
+
+    void clear() {
+        m_levels.clear();
+        queue_draw();
+    }
+
+    bool empty() const { return m_levels.empty(); }
+
+protected:
+    bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr) override {
+        if (m_levels.empty())
+            return true;
+        const double scale = view_scale();
+
+        // Below half size, paint from the pyramid level closest above the
+        // target so the filter never has to skip source pixels.
+        size_t level = 0;
+        double level_scale = scale;
+        while (level_scale < 0.5 && level < 12) {
+            if (level + 1 >= m_levels.size()) {
+                const auto& last = m_levels.back();
+                if (last->get_width() == 1 && last->get_height() == 1) break;
+                m_levels.push_back(downscale_half(last));
+            }
+            ++level;
+            level_scale *= 2.0;
+        }
+        const auto& surface = m_levels[level];
+        // Levels halve each axis separately and clamp at 1, so scale them apart.
+        const double fx = static_cast<double>(m_levels[0]->get_width()) / surface->get_width();
+        const double fy = static_cast<double>(m_levels[0]->get_height()) / surface->get_height();
+
+        cr->translate(std::round(get_allocated_width() / 2.0 - m_center_x * scale),
+                      std::round(get_allocated_height() / 2.0 - m_center_y * scale));
+        cr->scale(scale * fx, scale * fy);
+        auto pattern = Cairo::SurfacePattern::create(surface);
+        pattern->set_filter(scale >= 2.0 ? Cairo::FILTER_NEAREST : Cairo::FILTER_GOOD);
+        cr->set_source(pattern);
+        cr->paint();
+        return true;
+    }
+
+    bool on_button_press_event(GdkEventButton* event) override {
+        if (m_levels.empty()) return false;
+        if (event->type == GDK_2BUTTON_PRESS) {
+            m_fit = true;
+            m_center_x = m_levels[0]->get_width() / 2.0;
+            m_center_y = m_levels[0]->get_height() / 2.0;
+            queue_draw();
+        }
+        m_drag_x = event->x;
+        m_drag_y = event->y;
+        return true;
+    }
+
+    bool on_motion_notify_event(GdkEventMotion* event) override {
+        if (m_levels.empty()) return false;
+        double scale = view_scale();
+        m_zoom = scale;
+        m_fit = false;
+        m_center_x -= (event->x - m_drag_x) / scale;
+        m_center_y -= (event->y - m_drag_y) / scale;
+        m_drag_x = event->x;
+        m_drag_y = event->y;
+        queue_draw();
+        return true;
+    }
+
+    // Keeps the image point under the pointer where it is.
+    bool on_scroll_event(GdkEventScroll* event) override {
+        if (m_levels.empty()) return false;
+        double scale = view_scale();
+        double factor = event->direction == GDK_SCROLL_UP ? 1.25 : event->direction == GDK_SCROLL_DOWN ? 0.8 : 1.0;
+        double zoom = std::clamp(scale * factor, 1.0 / 64, 64.0);
+        double dx = event->x - get_allocated_width() / 2.0, dy = event->y - get_allocated_height() / 2.0;
+        m_center_x += dx / scale - dx / zoom;
+        m_center_y += dy / scale - dy / zoom;
+        m_zoom = zoom;
+        m_fit = false;
+        queue_draw();
+        return true;
+    }
+
+private:
+    double view_scale() const {
+        if (!m_fit) return m_zoom;
+        double w = m_levels[0]->get_width(), h = m_levels[0]->get_height();
+        double fit = std::min(get_allocated_width() / w, get_allocated_height() / h);
+        return fit > 0.0 ? std::min(1.0, fit) : 1.0;
+    }
+
+    std::vector<Cairo::RefPtr<Cairo::ImageSurface>> m_levels; // [0] full size, then halves, built on demand
+    bool m_fit = true;
+    double m_zoom = 1.0;
+    double m_center_x = 0.0, m_center_y = 0.0; // image point shown at the widget's centre
+    double m_drag_x = 0.0, m_drag_y = 0.0;
+};
@@ -1,9 +1,14 @@
 #pragma once
+#include <algorithm>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <stdexcept>
 #include <fstream>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 struct PCXImage {
     int width;
@@ -11,11 +16,12 @@ struct PCXImage {
     std::vector<uint8_t> rgba_data; // Now includes alpha
 };
 
-inline PCXImage load_pcx_from_memory(const std::vector<uint8_t>& data) {
-    if (data.size() < 128 + 769)
+// Validates the header of an 8-bit paletted PCX and returns its size.
+inline void pcx_dimensions(const uint8_t* data, size_t size, int& width, int& height) {
+    if (size < 128 + 769)
         throw std::runtime_error("Data too small to be a valid PCX");
 
-    const uint8_t* header = data.data();
+    const uint8_t* header = data;
     if (header[0] != 0x0A || header[1] != 5 || header[2] != 1 || header[3] != 8)
         throw std::runtime_error("Unsupported PCX format (only 8-bit)");
 
@@ -23,57 +29,117 @@ inline PCXImage load_pcx_from_memory(const std::vector<uint8_t>& data) {
     int ymin = header[6] | (header[7] << 8);
     int xmax = header[8] | (header[9] << 8);
     int ymax = header[10] | (header[11] << 8);
-    int width = xmax - xmin + 1;
-    int height = ymax - ymin + 1;
+    width = xmax - xmin + 1;
+    height = ymax - ymin + 1;
+    if (width <= 0 || height <= 0)
+        throw std::runtime_error("Invalid PCX dimensions");
+
+    int bytes_per_line = header[66] | (header[67] << 8);
+    if (bytes_per_line < width)
+        throw std::runtime_error("Invalid PCX line length");
+}
+
+// Palette index -> RGBA, stored in memory order so a pixel is one 4-byte copy.
+// Entries whose colour is #00FF00 are the transparent ones.
+inline void pcx_build_lut(const uint8_t* palette, uint32_t lut[256]) {
+    for (int i = 0; i < 256; ++i) {
+        uint8_t r = palette[i * 3 + 0];
+        uint8_t g = palette[i * 3 + 1];
+        uint8_t b = palette[i * 3 + 2];
+        uint8_t rgba[4] = {r, g, b, static_cast<uint8_t>((r == 0x00 && g == 0xFF && b == 0x00) ? 0 : 255)};
+        std::memcpy(&lut[i], rgba, 4);
+    }
+}
+
+// Expands `count` palette indices to RGBA. `dst` may overlap the indices as
+// long as they sit at or after dst + 3 * count (see decode_pcx_into).
+inline void pcx_expand_scalar(const uint8_t* indices, uint8_t* dst, int count, const uint32_t lut[256]) {
+    for (int i = 0; i < count; ++i)
+        std::memcpy(dst + i * 4, &lut[indices[i]], 4);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// Eight pixels per step with an AVX2 gather from the LUT. The indices are
+// loaded before the 32-byte store, and with the in-place layout a full
+// block's store never reaches the next block's indices.
+__attribute__((target("avx2")))
+inline void pcx_expand_avx2(const uint8_t* indices, uint8_t* dst, int count, const uint32_t lut[256]) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i idx8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i));
+        __m256i idx = _mm256_cvtepu8_epi32(idx8);
+        __m256i px = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), px);
+    }
+    pcx_expand_scalar(indices + i, dst + i * 4, count - i, lut);
+}
+#endif
+
+inline void pcx_expand(const uint8_t* indices, uint8_t* dst, int count, const uint32_t lut[256]) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        pcx_expand_avx2(indices, dst, count, lut);
+        return;
+    }
+#endif
+    pcx_expand_scalar(indices, dst, count, lut);
+}
 
+// Decodes an 8-bit PCX straight into `dst`: `height` rows of `width` RGBA
+// pixels, `stride` bytes apart (stride >= width * 4). Nothing is allocated.
+// Each row's indices are RLE-decoded into the last quarter of its own RGBA
+// row and then expanded forwards over themselves through the palette LUT.
+inline void decode_pcx_into(const uint8_t* data, size_t size, uint8_t* dst, size_t stride) {
+    int width, height;
+    pcx_dimensions(data, size, width, height);
+    const uint8_t* header = data;
     int bytes_per_line = header[66] | (header[67] << 8);
-    std::vector<uint8_t> image_data(width * height);
 
+    // Load palette
+    size_t palette_start = size - 769;
+    if (data[palette_start] != 0x0C)
+        throw std::runtime_error("Missing palette marker");
+    uint32_t lut[256];
+    pcx_build_lut(&data[palette_start + 1], lut);
+
+    const size_t end = palette_start;
     size_t pos = 128;
     for (int y = 0; y < height; ++y) {
-        std::vector<uint8_t> scanline(bytes_per_line);
-        size_t x = 0;
-        while (x < bytes_per_line && pos < data.size() - 769) {
+        uint8_t* row = dst + static_cast<size_t>(y) * stride;
+        uint8_t* indices = row + static_cast<size_t>(width) * 3;
+        int x = 0;
+        // Runs never carry over into the next line; bytes past `width` are padding.
+        while (x < bytes_per_line && pos < end) {
             uint8_t c = data[pos++];
             if ((c & 0xC0) == 0xC0) {
                 int count = c & 0x3F;
-                if (pos >= data.size() - 769)
+                if (pos >= end)
                     throw std::runtime_error("Unexpected end of data");
                 uint8_t val = data[pos++];
-                std::fill_n(scanline.begin() + x, count, val);
+                if (x < width)
+                    std::memset(indices + x, val, std::min(count, width - x));
                 x += count;
             } else {
-                scanline[x++] = c;
+                if (x < width)
+                    indices[x] = c;
+                ++x;
             }
         }
-        std::copy(scanline.begin(), scanline.begin() + width, image_data.begin() + y * width);
-    }
-
-    // Load palette
-    size_t palette_start = data.size() - 769;
-    if (data[palette_start] != 0x0C)
-        throw std::runtime_error("Missing palette marker");
-    const uint8_t* palette = &data[palette_start + 1];
-
-    // Determine which palette index is #00FF00
-    std::vector<bool> transparent_index(256, false);
-    for (int i = 0; i < 256; ++i) {
-        uint8_t r = palette[i * 3 + 0];
-        uint8_t g = palette[i * 3 + 1];
-        uint8_t b = palette[i * 3 + 2];
-        if (r == 0x00 && g == 0xFF && b == 0x00)
-            transparent_index[i] = true;
+        if (x < width)
+            std::memset(indices + x, 0, width - x);
+        pcx_expand(indices, row, width, lut);
     }
+}
 
-    // Convert indexed image to RGBA
-    std::vector<uint8_t> rgba(width * height * 4);
-    for (int i = 0; i < width * height; ++i) {
-        int idx = image_data[i];
-        rgba[i * 4 + 0] = palette[idx * 3 + 0];             // R
-        rgba[i * 4 + 1] = palette[idx * 3 + 1];             // G
-        rgba[i * 4 + 2] = palette[idx * 3 + 2];             // B
-        rgba[i * 4 + 3] = transparent_index[idx] ? 0 : 255; // A
-    }
+inline PCXImage load_pcx_from_memory(const uint8_t* bytes, size_t size) {
+    PCXImage image;
+    pcx_dimensions(bytes, size, image.width, image.height);
+    image.rgba_data.resize(static_cast<size_t>(image.width) * image.height * 4);
+    decode_pcx_into(bytes, size, image.rgba_data.data(), static_cast<size_t>(image.width) * 4);
+    return image;
+}
 
-    return {width, height, std::move(rgba)};
+inline PCXImage load_pcx_from_memory(const std::vector<uint8_t>& data) {
+    return load_pcx_from_memory(data.data(), data.size());
 }
@@ -0,0 +1,369 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// FreeSpace POF models: "PSPO", a version, then chunks of (id, length,
+// data). load() only indexes the chunks and reads the header, textures and
+// subobject headers; a subobject's BSP geometry is decoded the first time
+// mesh() asks for it.
+
+struct POFVec {
+    float x, y, z;
+};
+
+inline POFVec operator+(POFVec a, POFVec b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+
+struct POFChunk {
+    char id[4];
+    size_t offset; // of the chunk data, after the 8-byte chunk header
+    size_t size;
+};
+
+struct POFSubobject {
+    int number = -1; // -1 for numbers no chunk defined
+    int parent = -1;
+    float radius = 0.0f;
+    POFVec offset{};
+    POFVec center{};
+    POFVec min{}, max{};
+    std::string name;
+    std::string properties;
+    size_t bsp_offset = 0;
+    size_t bsp_size = 0;
+};
+
+struct POFTriangle {
+    POFVec v[3];
+    POFVec normal;
+    uint8_t r, g, b;
+};
+
+struct POFMesh {
+    std::vector<POFTriangle> triangles; // relative to the subobject's own origin
+};
+
+// BSP block ids inside a subobject's geometry.
+enum POFBSPOp : int32_t {
+    POF_BSP_EOF = 0,
+    POF_BSP_DEFPOINTS = 1,
+    POF_BSP_FLATPOLY = 2,
+    POF_BSP_TMAPPOLY = 3,
+    POF_BSP_SORTNORM = 4,
+    POF_BSP_BOUNDBOX = 5,
+};
+
+// Bounds-checked little-endian reads over a byte range.
+class POFReader {
+public:
+    POFReader(const uint8_t* data, size_t size, size_t pos = 0) : m_data(data), m_size(size), m_pos(pos) {}
+
+    size_t pos() const { return m_pos; }
+    void seek(size_t pos) { m_pos = pos; }
+
+    void need(size_t n) const {
+        if (m_pos > m_size || m_size - m_pos < n)
+            throw std::runtime_error("Truncated POF data");
+    }
+    void skip(size_t n) { need(n); m_pos += n; }
+
+    uint8_t u8() { need(1); return m_data[m_pos++]; }
+    int16_t i16() { return get<int16_t>(); }
+    int32_t i32() { return get<int32_t>(); }
+    float f32() { return get<float>(); }
+    POFVec vec() {
+        POFVec v;
+        v.x = f32();
+        v.y = f32();
+        v.z = f32();
+        return v;
+    }
+    std::string str() {
+        int32_t len = i32();
+        if (len < 0) throw std::runtime_error("Invalid POF string");
+        need(static_cast<size_t>(len));
+        std::string s(reinterpret_cast<const char*>(m_data + m_pos), strnlen(reinterpret_cast<const char*>(m_data + m_pos), len));
+        m_pos += len;
+        return s;
+    }
+
+private:
+    template <typename T>
+    T get() {
+        need(sizeof(T));
+        T v;
+        std::memcpy(&v, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return v;
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos;
+};
+
+class POFModel {
+public:
+    // Copies the file; `data` need not outlive the model.
+    void load(const uint8_t* data, size_t size) {
+        if (size < 8 || std::memcmp(data, "PSPO", 4) != 0)
+            throw std::runtime_error("Not a POF model");
+        m_bytes.assign(data, data + size);
+        m_chunks.clear();
+        m_subobjects.clear();
+        m_meshes.clear();
+        m_textures.clear();
+        m_detail_levels.clear();
+
+        POFReader r(m_bytes.data(), m_bytes.size(), 4);
+        m_version = r.i32();
+        while (r.pos() + 8 <= m_bytes.size()) {
+            POFChunk chunk;
+            r.need(4);
+            std::memcpy(chunk.id, m_bytes.data() + r.pos(), 4);
+            r.skip(4);
+            int32_t length = r.i32();
+            if (length < 0 || static_cast<size_t>(length) > m_bytes.size() - r.pos())
+                throw std::runtime_error("POF chunk runs past the end of the file");
+            chunk.offset = r.pos();
+            chunk.size = static_cast<size_t>(length);
+            m_chunks.push_back(chunk);
+            r.skip(chunk.size);
+        }
+
+        for (const auto& chunk : m_chunks) {
+            POFReader c(m_bytes.data(), chunk.offset + chunk.size, chunk.offset);
+            if (is(chunk, "HDR2") || is(chunk, "OHDR"))
+                read_header(c, is(chunk, "HDR2"));
+            else if (is(chunk, "OBJ2") || is(chunk, "SOBJ"))
+                read_subobject(c, is(chunk, "OBJ2"));
+            else if (is(chunk, "TXTR")) {
+                int32_t n = c.i32();
+                for (int32_t i = 0; i < n; ++i)
+                    m_textures.push_back(c.str());
+            }
+        }
+        m_meshes.resize(m_subobjects.size());
+    }
+
+    int version() const { return m_version; }
+    float radius() const { return m_radius; }
+    const std::vector<POFChunk>& chunks() const { return m_chunks; }
+    const std::vector<POFSubobject>& subobjects() const { return m_subobjects; }
+    const std::vector<std::string>& textures() const { return m_textures; }
+    const std::vector<int>& detail_levels() const { return m_detail_levels; }
+
+    const POFChunk* find_chunk(const char* id) const {
+        for (const auto& chunk : m_chunks)
+            if (is(chunk, id)) return &chunk;
+        return nullptr;
+    }
+
+    // Decodes subobject `n`'s BSP geometry on first use.
+    const POFMesh& mesh(int n) {
+        auto& slot = m_meshes.at(n);
+        if (!slot) {
+            slot = std::make_unique<POFMesh>();
+            const auto& sub = m_subobjects[n];
+            if (sub.bsp_size > 0)
+                decode_bsp(m_bytes.data() + sub.bsp_offset, sub.bsp_size, *slot);
+        }
+        return *slot;
+    }
+
+    // Offset of subobject `n` from the model origin, through its parents.
+    POFVec world_offset(int n) const {
+        POFVec v{};
+        for (int depth = 0; n >= 0 && n < static_cast<int>(m_subobjects.size()) && depth < 64; ++depth) {
+            v = v + m_subobjects[n].offset;
+            n = m_subobjects[n].parent;
+        }
+        return v;
+    }
+
+    // The root of detail level `detail` and everything below it; with no
+    // detail levels, every subobject without a parent and its children.
+    std::vector<int> displayed_subobjects(int detail = 0) const {
+        std::vector<int> roots;
+        if (detail < static_cast<int>(m_detail_levels.size()))
+            roots.push_back(m_detail_levels[detail]);
+        else
+            for (const auto& sub : m_subobjects)
+                if (sub.number >= 0 && sub.parent < 0) roots.push_back(sub.number);
+
+        std::vector<int> shown;
+        std::vector<bool> seen(m_subobjects.size());
+        for (size_t i = 0; i < roots.size(); ++i) {
+            int n = roots[i];
+            if (n < 0 || n >= static_cast<int>(m_subobjects.size()) || seen[n] || m_subobjects[n].number < 0)
+                continue;
+            seen[n] = true;
+            shown.push_back(n);
+            for (const auto& sub : m_subobjects)
+                if (sub.number >= 0 && sub.parent == n) roots.push_back(sub.number);
+        }
+        return shown;
+    }
+
+    // Triangles of the displayed subobjects, in model space. Only these
+    // subobjects' geometry gets decoded.
+    std::vector<POFTriangle> triangles(int detail = 0) {
+        std::vector<POFTriangle> out;
+        for (int n : displayed_subobjects(detail)) {
+            const POFMesh& m = mesh(n);
+            POFVec offset = world_offset(n);
+            for (POFTriangle t : m.triangles) {
+                for (auto& v : t.v) v = v + offset;
+                out.push_back(t);
+            }
+        }
+        return out;
+    }
+
+private:
+    static bool is(const POFChunk& chunk, const char* id) { return std::memcmp(chunk.id, id, 4) == 0; }
+
+    // HDR2 leads with the radius, the older OHDR with the subobject count.
+    void read_header(POFReader& r, bool hdr2) {
+        if (hdr2) {
+            m_radius = r.f32();
+            r.i32(); // flags
+            r.i32(); // subobject count
+        } else {
+            r.i32();
+            m_radius = r.f32();
+            r.i32();
+        }
+        r.vec(); // bounding box
+        r.vec();
+        int32_t n = r.i32();
+        for (int32_t i = 0; i < n; ++i)
+            m_detail_levels.push_back(r.i32());
+    }
+
+    // OBJ2 and SOBJ hold the same fields; the first four come in a different order.
+    void read_subobject(POFReader& r, bool obj2) {
+        POFSubobject sub;
+        sub.number = r.i32();
+        if (obj2) {
+            sub.radius = r.f32();
+            sub.parent = r.i32();
+            sub.offset = r.vec();
+        } else {
+            sub.parent = r.i32();
+            sub.offset = r.vec();
+            sub.radius = r.f32();
+        }
+        sub.center = r.vec();
+        sub.min = r.vec();
+        sub.max = r.vec();
+        sub.name = r.str();
+        sub.properties = r.str();
+        r.i32(); // movement type
+        r.i32(); // movement axis
+        r.i32(); // reserved
+        int32_t bsp_size = r.i32();
+        if (sub.number < 0 || sub.number > 4096 || bsp_size < 0)
+            throw std::runtime_error("Invalid POF subobject");
+        sub.bsp_offset = r.pos();
+        sub.bsp_size = static_cast<size_t>(bsp_size);
+        r.skip(sub.bsp_size);
+
+        if (sub.number >= static_cast<int>(m_subobjects.size()))
+            m_subobjects.resize(sub.number + 1);
+        m_subobjects[sub.number] = std::move(sub);
+    }
+
+    // Walks the BSP tree. Every block is visited once, whether it is
+    // reached by following the chain or through a SORTNORM's child offsets.
+    static void decode_bsp(const uint8_t* bsp, size_t size, POFMesh& mesh) {
+        std::vector<POFVec> points;
+        std::vector<bool> visited(size / 4 + 1);
+        std::vector<size_t> pending{0};
+        while (!pending.empty()) {
+            size_t offset = pending.back();
+            pending.pop_back();
+            while (offset + 8 <= size && !visited[offset / 4]) {
+                visited[offset / 4] = true;
+                POFReader r(bsp, size, offset);
+                int32_t id = r.i32();
+                int32_t length = r.i32();
+                if (id == POF_BSP_EOF) break;
+                switch (id) {
+                case POF_BSP_DEFPOINTS: {
+                    int32_t n_verts = r.i32();
+                    r.i32(); // normal count
+                    int32_t data_offset = r.i32();
+                    if (n_verts < 0 || data_offset < 0) throw std::runtime_error("Invalid POF vertex list");
+                    r.need(static_cast<size_t>(n_verts));
+                    const uint8_t* norm_counts = bsp + r.pos();
+                    POFReader v(bsp, size, offset + data_offset);
+                    points.resize(n_verts);
+                    for (int32_t i = 0; i < n_verts; ++i) {
+                        points[i] = v.vec();
+                        v.skip(static_cast<size_t>(norm_counts[i]) * 12);
+                    }
+                    break;
+                }
+                case POF_BSP_FLATPOLY:
+                case POF_BSP_TMAPPOLY: {
+                    POFVec normal = r.vec();
+                    r.vec();   // center
+                    r.f32();   // radius
+                    int32_t n = r.i32();
+                    uint8_t rgb[3] = {170, 170, 170};
+                    if (id == POF_BSP_FLATPOLY) {
+                        rgb[0] = r.u8(); rgb[1] = r.u8(); rgb[2] = r.u8();
+                        r.u8();
+                    } else {
+                        r.i32(); // texture
+                    }
+                    if (n < 3 || n > 4096) break;
+                    size_t vert_size = id == POF_BSP_FLATPOLY ? 4 : 12;
+                    auto vertex = [&](int32_t i) {
+                        POFReader p(bsp, size, r.pos() + i * vert_size);
+                        int idx = static_cast<uint16_t>(p.i16());
+                        if (idx >= static_cast<int>(points.size()))
+                            throw std::runtime_error("POF polygon uses an undefined vertex");
+                        return points[idx];
+                    };
+                    POFVec first = vertex(0), prev = vertex(1);
+                    for (int32_t i = 2; i < n; ++i) {
+                        POFVec cur = vertex(i);
+                        mesh.triangles.push_back({{first, prev, cur}, normal, rgb[0], rgb[1], rgb[2]});
+                        prev = cur;
+                    }
+                    break;
+                }
+                case POF_BSP_SORTNORM: {
+                    r.vec(); // plane normal
+                    r.vec(); // plane point
+                    r.i32(); // reserved
+                    for (int k = 0; k < 5; ++k) { // front, back, prelist, postlist, online
+                        int32_t child = r.i32();
+                        if (child > 0 && offset + child < size)
+                            pending.push_back(offset + child);
+                    }
+                    break;
+                }
+                default: // BOUNDBOX and anything unknown
+                    break;
+                }
+                if (length <= 0) break;
+                offset += static_cast<size_t>(length);
+            }
+        }
+    }
+
+    std::vector<uint8_t> m_bytes;
+    int m_version = 0;
+    float m_radius = 0.0f;
+    std::vector<POFChunk> m_chunks;
+    std::vector<POFSubobject> m_subobjects; // indexed by subobject number
+    std::vector<std::unique_ptr<POFMesh>> m_meshes;
+    std::vector<std::string> m_textures;
+    std::vector<int> m_detail_levels;
+};
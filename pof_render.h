@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pof_decoder.h"
+
+struct POFCamera {
+    float yaw = 0.6f;   // radians about the vertical axis
+    float pitch = 0.3f; // radians about the horizontal axis
+    float zoom = 1.0f;
+};
+
+enum class POFRenderMode { Flat, Wireframe };
+
+// Orthographic software rasterizer for model previews. render() transforms
+// the triangles in parallel, then splits the image into horizontal bands,
+// one per thread; each band owns its slice of the colour and depth buffers,
+// so the threads never share a pixel. The threads are started on the first
+// parallel frame and kept for the renderer's lifetime, since starting them
+// per frame would cost more than rasterizing a small model. Output is 32-bit
+// 0x00RRGGBB, the layout of a Cairo FORMAT_RGB24 surface.
+class POFRenderer {
+public:
+    POFRenderer() = default;
+    POFRenderer(const POFRenderer&) = delete;
+    POFRenderer& operator=(const POFRenderer&) = delete;
+
+    ~POFRenderer() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (auto& th : m_workers) th.join();
+    }
+
+    void set_triangles(std::vector<POFTriangle> triangles) {
+        m_triangles = std::move(triangles);
+        POFVec lo{1e30f, 1e30f, 1e30f}, hi{-1e30f, -1e30f, -1e30f};
+        for (const auto& t : m_triangles)
+            for (const auto& v : t.v) {
+                lo = {std::min(lo.x, v.x), std::min(lo.y, v.y), std::min(lo.z, v.z)};
+                hi = {std::max(hi.x, v.x), std::max(hi.y, v.y), std::max(hi.z, v.z)};
+            }
+        m_center = m_triangles.empty() ? POFVec{} : POFVec{(lo.x + hi.x) / 2, (lo.y + hi.y) / 2, (lo.z + hi.z) / 2};
+        m_radius = 0.0f;
+        for (const auto& t : m_triangles)
+            for (const auto& v : t.v) {
+                float dx = v.x - m_center.x, dy = v.y - m_center.y, dz = v.z - m_center.z;
+                m_radius = std::max(m_radius, dx * dx + dy * dy + dz * dz);
+            }
+        m_radius = m_radius > 0.0f ? std::sqrt(m_radius) : 1.0f;
+    }
+
+    size_t triangle_count() const { return m_triangles.size(); }
+
+    void render(uint32_t* pixels, int width, int height, size_t stride, const POFCamera& camera,
+                POFRenderMode mode, unsigned threads = 0) {
+        if (width <= 0 || height <= 0) return;
+        if (threads == 0)
+            threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+        threads = std::min(threads, static_cast<unsigned>(height));
+        m_projected.resize(m_triangles.size());
+        m_depth.resize(static_cast<size_t>(width) * height);
+
+        // Projection is cheap per triangle; only split it for large models.
+        const unsigned project_threads = m_triangles.size() < 4096 ? 1 : threads;
+        parallel(project_threads, [&](unsigned t) {
+            size_t begin = m_triangles.size() * t / project_threads;
+            size_t end = m_triangles.size() * (t + 1) / project_threads;
+            project(begin, end, width, height, camera);
+        });
+        parallel(threads, [&](unsigned t) {
+            int y0 = height * t / threads;
+            int y1 = height * (t + 1) / threads;
+            raster_band(pixels, width, stride, y0, y1, mode);
+        });
+    }
+
+private:
+    struct Projected {
+        float x[3], y[3], z[3]; // screen space; z grows towards the viewer
+        uint32_t color;
+    };
+
+    // Runs f(0) .. f(threads - 1), f(0) on the calling thread and the rest
+    // on pool workers, and returns once all of them have finished.
+    void parallel(unsigned threads, const std::function<void(unsigned)>& f) {
+        if (threads <= 1) {
+            f(0u);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (m_workers.size() + 1 < threads) {
+                unsigned index = static_cast<unsigned>(m_workers.size()) + 1;
+                m_workers.emplace_back([this, index]() { worker(index); });
+            }
+            m_task = &f;
+            m_task_threads = threads;
+            m_pending = threads - 1;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+        f(0u);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+        m_task = nullptr;
+    }
+
+    void worker(unsigned index) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [&]() { return m_quit || m_generation != seen; });
+            if (m_quit) return;
+            seen = m_generation;
+            if (index >= m_task_threads) continue;
+            const auto* task = m_task;
+            lock.unlock();
+            (*task)(index);
+            lock.lock();
+            if (--m_pending == 0)
+                m_done.notify_one();
+        }
+    }
+
+    void project(size_t begin, size_t end, int width, int height, const POFCamera& camera) {
+        const float cy = std::cos(camera.yaw), sy = std::sin(camera.yaw);
+        const float cp = std::cos(camera.pitch), sp = std::sin(camera.pitch);
+        const float scale = camera.zoom * 0.45f * std::min(width, height) / m_radius;
+        const float light[3] = {0.32f, 0.55f, 0.77f};
+        auto rotate = [&](float x, float y, float z, float out[3]) {
+            float x1 = x * cy + z * sy, z1 = -x * sy + z * cy;
+            out[0] = x1;
+            out[1] = y * cp - z1 * sp;
+            out[2] = y * sp + z1 * cp;
+        };
+        for (size_t i = begin; i < end; ++i) {
+            const POFTriangle& t = m_triangles[i];
+            Projected& p = m_projected[i];
+            for (int k = 0; k < 3; ++k) {
+                float r[3];
+                rotate(t.v[k].x - m_center.x, t.v[k].y - m_center.y, t.v[k].z - m_center.z, r);
+                p.x[k] = width * 0.5f + r[0] * scale;
+                p.y[k] = height * 0.5f - r[1] * scale;
+                p.z[k] = r[2];
+            }
+            float n[3];
+            rotate(t.normal.x, t.normal.y, t.normal.z, n);
+            float shade = 0.25f + 0.75f * std::fabs(n[0] * light[0] + n[1] * light[1] + n[2] * light[2]);
+            shade = std::min(shade, 1.0f);
+            p.color = (uint32_t(t.r * shade) << 16) | (uint32_t(t.g * shade) << 8) | uint32_t(t.b * shade);
+        }
+    }
+
+    void raster_band(uint32_t* pixels, int width, size_t stride, int y0, int y1, POFRenderMode mode) {
+        const uint32_t background = 0x202428;
+        for (int y = y0; y < y1; ++y) {
+            uint32_t* row = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(pixels) + stride * y);
+            std::fill(row, row + width, background);
+            std::fill(&m_depth[static_cast<size_t>(y) * width], &m_depth[static_cast<size_t>(y) * width] + width,
+                      -std::numeric_limits<float>::infinity());
+        }
+
+        for (const Projected& p : m_projected) {
+            float top = std::min({p.y[0], p.y[1], p.y[2]});
+            float bottom = std::max({p.y[0], p.y[1], p.y[2]});
+            if (bottom < y0 || top >= y1) continue;
+            if (mode == POFRenderMode::Wireframe) {
+                for (int k = 0; k < 3; ++k)
+                    line(pixels, width, stride, y0, y1, p.x[k], p.y[k], p.x[(k + 1) % 3], p.y[(k + 1) % 3], 0xB0D0F0);
+            } else {
+                fill(pixels, width, stride, y0, y1, p);
+            }
+        }
+    }
+
+    // Edge functions over the triangle's bounding box, clipped to the band,
+    // sampling at pixel centres; both windings are drawn.
+    void fill(uint32_t* pixels, int width, size_t stride, int y0, int y1, const Projected& p) {
+        float area = (p.x[1] - p.x[0]) * (p.y[2] - p.y[0]) - (p.x[2] - p.x[0]) * (p.y[1] - p.y[0]);
+        if (std::fabs(area) < 1e-6f) return;
+        if (!std::isfinite(area)) return;
+        float inv = 1.0f / area;
+        // Clamp in float first: at extreme zoom the projected coordinates
+        // need not fit in an int.
+        auto clamp_x = [&](float v) { return std::min(std::max(v, -1.0f), static_cast<float>(width)); };
+        auto clamp_y = [&](float v) { return std::min(std::max(v, y0 - 1.0f), static_cast<float>(y1)); };
+        int minx = std::max(0, static_cast<int>(std::floor(clamp_x(std::min({p.x[0], p.x[1], p.x[2]})))));
+        int maxx = std::min(width - 1, static_cast<int>(std::ceil(clamp_x(std::max({p.x[0], p.x[1], p.x[2]})))));
+        int miny = std::max(y0, static_cast<int>(std::floor(clamp_y(std::min({p.y[0], p.y[1], p.y[2]})))));
+        int maxy = std::min(y1 - 1, static_cast<int>(std::ceil(clamp_y(std::max({p.y[0], p.y[1], p.y[2]})))));
+        for (int y = miny; y <= maxy; ++y) {
+            uint32_t* row = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(pixels) + stride * y);
+            float* depth = &m_depth[static_cast<size_t>(y) * width];
+            float py = y + 0.5f;
+            for (int x = minx; x <= maxx; ++x) {
+                float px = x + 0.5f;
+                float w0 = ((p.x[1] - px) * (p.y[2] - py) - (p.x[2] - px) * (p.y[1] - py)) * inv;
+                float w1 = ((p.x[2] - px) * (p.y[0] - py) - (p.x[0] - px) * (p.y[2] - py)) * inv;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+                float z = w0 * p.z[0] + w1 * p.z[1] + w2 * p.z[2];
+                if (z > depth[x]) {
+                    depth[x] = z;
+                    row[x] = p.color;
+                }
+            }
+        }
+    }
+
+    static void line(uint32_t* pixels, int width, size_t stride, int y0, int y1,
+                     float ax, float ay, float bx, float by, uint32_t color) {
+        float length = std::max(std::fabs(bx - ax), std::fabs(by - ay));
+        if (!(length <= 16384.0f)) return; // degenerate projection, or NaN
+        int steps = static_cast<int>(length) + 1;
+        float dx = (bx - ax) / steps, dy = (by - ay) / steps;
+        for (int i = 0; i <= steps; ++i) {
+            // Range-check in float before converting; the endpoints may lie
+            // far outside the image.
+            float fx = ax + dx * i, fy = ay + dy * i;
+            if (!(fx > -1.0f && fx < width && fy > y0 - 1.0f && fy < y1)) continue;
+            int x = static_cast<int>(fx), y = static_cast<int>(fy);
+            if (x < 0 || x >= width || y < y0 || y >= y1) continue;
+            reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(pixels) + stride * y)[x] = color;
+        }
+    }
+
+    std::vector<POFTriangle> m_triangles;
+    std::vector<Projected> m_projected;
+    std::vector<float> m_depth;
+    POFVec m_center{};
+    float m_radius = 1.0f;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(unsigned)>* m_task = nullptr;
+    unsigned m_task_threads = 0;
+    unsigned m_pending = 0;
+    uint64_t m_generation = 0;
+    bool m_quit = false;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Thread-safe LRU map bounded by a byte budget rather than an item count.
+// Each value is inserted with its own cost; the least recently used items
+// are evicted until the total fits the budget again. An item larger than
+// the whole budget is not cached at all.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+        size_t items = 0;
+        size_t budget = 0;
+    };
+
+    explicit LRUCache(size_t budget_bytes) : m_budget(budget_bytes) {}
+
+    // Looks up `key`, counting a hit or a miss and marking it most recent.
+    bool get(const Key& key, Value& out) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            ++m_stats.misses;
+            return false;
+        }
+        ++m_stats.hits;
+        m_items.splice(m_items.begin(), m_items, it->second);
+        out = it->second->value;
+        return true;
+    }
+
+    // Presence check that neither counts nor reorders; used by prefetching.
+    bool contains(const Key& key) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_index.count(key) != 0;
+    }
+
+    void put(const Key& key, Value value, size_t cost) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_bytes -= it->second->cost;
+            m_items.erase(it->second);
+            m_index.erase(it);
+        }
+        if (cost > m_budget) return;
+        m_items.push_front({key, std::move(value), cost});
+        m_index[key] = m_items.begin();
+        m_bytes += cost;
+        evict();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+
+    void set_budget(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = budget_bytes;
+        evict();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s = m_stats;
+        s.bytes = m_bytes;
+        s.items = m_items.size();
+        s.budget = m_budget;
+        return s;
+    }
+
+private:
+    struct Item {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+
+    void evict() {
+        while (m_bytes > m_budget && !m_items.empty()) {
+            const Item& victim = m_items.back();
+            m_bytes -= victim.cost;
+            m_index.erase(victim.key);
+            m_items.pop_back();
+            ++m_stats.evictions;
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::list<Item> m_items; // most recent first
+    std::unordered_map<Key, typename std::list<Item>::iterator, Hash> m_index;
+    size_t m_budget;
+    size_t m_bytes = 0;
+    Stats m_stats;
+};
@@ -0,0 +1,284 @@
+#pragma once
+#include <gtkmm.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "dds_decoder.h"
+#include "pcx_decoder.h"
+#include "preview_cache.h"
+#include "text_scan.h"
+#include "tga_decoder.h"
+#include "vp_parser.h"
+#include "vp_trace.h"
+
+enum class PreviewKind { Text, PCX, DDS, TGA, Image };
+
+struct PreviewResult {
+    PreviewKind kind = PreviewKind::Text;
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    std::string text; // text previews (as UTF-8), or the error for a failed decode
+    TextScan scan;    // highlighting and outline of a text preview
+    bool converted = false; // the text was not UTF-8 and was converted
+    bool failed = false;
+
+    size_t memory_usage() const {
+        size_t bytes = sizeof(*this) + text.capacity() + scan.memory_usage();
+        if (pixbuf)
+            bytes += static_cast<size_t>(pixbuf->get_rowstride()) * pixbuf->get_height();
+        return bytes;
+    }
+};
+
+// Decoded previews keyed by (archive index << 32 | entry index). Kinds
+// whose decode depends on the target size (the DDS mip level) also carry
+// its size class in the top 10 bits; archive indices stay far below 2^22.
+using PreviewCache = LRUCache<uint64_t, std::shared_ptr<const PreviewResult>>;
+
+inline uint64_t preview_key(uint32_t archive, uint32_t entry, uint32_t size_class = 0) {
+    return (static_cast<uint64_t>(size_class) << 54) | (static_cast<uint64_t>(archive) << 32) | entry;
+}
+
+// log2 of `size` rounded up to a power of two.
+inline uint32_t preview_axis_class(int size) {
+    uint32_t axis = 0;
+    while (axis < 30 && (1 << axis) < size)
+        ++axis;
+    return axis;
+}
+
+// Each axis of the target is rounded up to a power of two on its own, so
+// one window size maps to one class and the level decoded for a class
+// covers every size in it. Width class in the high 5 bits, height below.
+inline uint32_t preview_size_class(int width, int height) {
+    return (preview_axis_class(width) << 5) | preview_axis_class(height);
+}
+
+// Reads and decodes previews on a background thread. Only the newest
+// request matters: submitting replaces any request that has not started
+// yet, and results of superseded requests are dropped, so holding an arrow
+// key down through a directory never queues work behind the selection.
+// Results are handed back on the GTK main loop through signal_ready().
+//
+// Every decode lands in cache(). When there is no request pending the
+// worker decodes the prefetch list into the cache as well, so stepping to a
+// neighbouring entry is usually a cache hit on the main thread.
+class PreviewWorker {
+public:
+    explicit PreviewWorker(size_t cache_budget)
+    : m_cache(cache_budget), m_thread([this]() { run(); }) {}
+
+    ~PreviewWorker() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    Glib::Dispatcher& signal_ready() { return m_ready; }
+    PreviewCache& cache() { return m_cache; }
+    const PreviewCache& cache() const { return m_cache; }
+
+    // Size of the area previews are shown in; formats with mip levels
+    // decode the smallest level that still fills it, rounded up to its
+    // size class. Their cache keys must include size_class().
+    void set_target_size(int width, int height) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_size_class = preview_size_class(width, height);
+        m_target_width = 1 << preview_axis_class(width);
+        m_target_height = 1 << preview_axis_class(height);
+    }
+
+    uint32_t size_class() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size_class;
+    }
+
+    uint64_t submit(PreviewKind kind, const VPParser& parser, const VPEntry& entry, uint64_t key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = {++m_generation, kind, &parser, entry, key, m_target_width, m_target_height};
+        m_has_job = true;
+        m_wake.notify_all();
+        return m_generation;
+    }
+
+    // Replaces the prefetch list. Entries already cached are skipped.
+    void prefetch(std::vector<std::tuple<PreviewKind, const VPParser*, VPEntry, uint64_t>> items) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_prefetch.clear();
+        for (auto& [kind, parser, entry, key] : items)
+            m_prefetch.push_back({0, kind, parser, entry, key, m_target_width, m_target_height});
+        m_wake.notify_all();
+    }
+
+    // Drops the pending request and any result still in flight.
+    void cancel() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+        m_has_job = false;
+        m_result.reset();
+    }
+
+    // cancel(), then drops the prefetch list and cache and waits for a
+    // running decode to finish. Call before unloading the archives.
+    void cancel_and_wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_generation;
+        m_has_job = false;
+        m_result.reset();
+        m_prefetch.clear();
+        m_idle.wait(lock, [this]() { return !m_busy; });
+        m_cache.clear();
+    }
+
+    // Takes the newest result if it belongs to the newest request.
+    std::shared_ptr<const PreviewResult> take_result() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_result_generation != m_generation) return nullptr;
+        return std::move(m_result);
+    }
+
+private:
+    struct Job {
+        uint64_t generation = 0; // 0 for prefetches
+        PreviewKind kind = PreviewKind::Text;
+        const VPParser* parser = nullptr;
+        VPEntry entry{};
+        uint64_t key = 0;
+        int target_width = 0;
+        int target_height = 0;
+    };
+
+    void run() {
+        vp_trace_name_thread("preview worker");
+        std::vector<uint8_t> scratch;
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || m_has_job || !m_prefetch.empty(); });
+                if (m_stop) return;
+                if (m_has_job) {
+                    job = m_job;
+                    m_has_job = false;
+                } else {
+                    job = m_prefetch.front();
+                    m_prefetch.pop_front();
+                    if (m_cache.contains(job.key)) continue;
+                }
+                m_busy = true;
+            }
+
+            auto result = std::make_shared<PreviewResult>(decode(job, scratch));
+            m_cache.put(job.key, result, result->memory_usage());
+
+            bool emit = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy = false;
+                if (job.generation != 0 && job.generation == m_generation) {
+                    m_result = std::move(result);
+                    m_result_generation = job.generation;
+                    emit = true;
+                }
+            }
+            m_idle.notify_all();
+            if (emit)
+                m_ready.emit();
+        }
+    }
+
+    PreviewResult decode(const Job& job, std::vector<uint8_t>& scratch) {
+        PreviewResult result;
+        result.kind = job.kind;
+
+        VPTraceScope trace(job.kind == PreviewKind::Text ? "decode text"
+                           : job.kind == PreviewKind::PCX ? "decode PCX"
+                           : job.kind == PreviewKind::DDS ? "decode DDS"
+                           : job.kind == PreviewKind::TGA ? "decode TGA"
+                                                          : "decode image");
+        trace.set_bytes(job.entry.size);
+        trace.set_detail(job.entry.full_path);
+        VPView data = job.parser->read(job.entry, scratch);
+        if (data.empty()) {
+            result.failed = true;
+            result.text = "[Entry lies outside the archive]";
+            return result;
+        }
+
+        try {
+            switch (job.kind) {
+            case PreviewKind::Text:
+                result.converted = text_to_utf8(data.data, data.size, result.text);
+                result.scan = text_scan(result.text);
+                break;
+            case PreviewKind::PCX: {
+                int width, height;
+                pcx_dimensions(data.data, data.size, width, height);
+                result.pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, width, height);
+                decode_pcx_into(data.data, data.size, result.pixbuf->get_pixels(), result.pixbuf->get_rowstride());
+                break;
+            }
+            case PreviewKind::TGA: {
+                int width, height;
+                tga_dimensions(data.data, data.size, width, height);
+                result.pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, width, height);
+                decode_tga_into(data.data, data.size, result.pixbuf->get_pixels(), result.pixbuf->get_rowstride());
+                break;
+            }
+            case PreviewKind::DDS: {
+                DDSInfo info = dds_parse(data.data, data.size);
+                int level = dds_pick_level(info, job.target_width, job.target_height);
+                result.pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, dds_level_width(info, level),
+                                                    dds_level_height(info, level));
+                decode_dds_into(info, data.data, data.size, level, result.pixbuf->get_pixels(),
+                                result.pixbuf->get_rowstride());
+                break;
+            }
+            case PreviewKind::Image: {
+                auto loader = Gdk::PixbufLoader::create();
+                loader->write(data.data, data.size);
+                loader->close();
+                result.pixbuf = loader->get_pixbuf();
+                if (!result.pixbuf)
+                    throw std::runtime_error("no image");
+                break;
+            }
+            }
+        } catch (...) {
+            result.failed = true;
+            result.pixbuf.reset();
+            result.text = job.kind == PreviewKind::PCX ? "[Invalid PCX image]"
+                        : job.kind == PreviewKind::DDS ? "[Invalid or unsupported DDS texture]"
+                        : job.kind == PreviewKind::TGA ? "[Invalid or unsupported TGA image]"
+                                                       : "[Unknown binary or unsupported format]";
+        }
+        return result;
+    }
+
+    PreviewCache m_cache;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    Glib::Dispatcher m_ready;
+    Job m_job;
+    std::deque<Job> m_prefetch;
+    std::shared_ptr<const PreviewResult> m_result;
+    uint64_t m_result_generation = 0;
+    uint64_t m_generation = 0;
+    int m_target_width = 0;
+    int m_target_height = 0;
+    uint32_t m_size_class = 0;
+    bool m_has_job = false;
+    bool m_busy = false;
+    bool m_stop = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,284 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <strings.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
+// Length of the leading run of ASCII bytes other than NUL, sixteen bytes
+// at a time with SSE2.
+inline size_t text_ascii_prefix(const uint8_t* p, size_t n) {
+    size_t i = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int stop = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (stop) return i + static_cast<size_t>(__builtin_ctz(stop));
+    }
+#endif
+    while (i < n && p[i] != 0 && p[i] < 0x80)
+        ++i;
+    return i;
+}
+
+// Length (2 to 4) of the well-formed UTF-8 sequence starting with a
+// non-ASCII byte at p, or 0: overlong forms, surrogates and code points
+// past U+10FFFF are rejected.
+inline size_t text_utf8_sequence(const uint8_t* p, size_t n) {
+    const uint8_t c = p[0];
+    size_t len;
+    if (c >= 0xC2 && c <= 0xDF) len = 2;
+    else if ((c & 0xF0) == 0xE0) len = 3;
+    else if (c >= 0xF0 && c <= 0xF4) len = 4;
+    else return 0;
+    if (len > n) return 0;
+    uint32_t cp = c & (0x7F >> len);
+    for (size_t k = 1; k < len; ++k) {
+        if ((p[k] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (p[k] & 0x3F);
+    }
+    if (len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) return 0;
+    if (len == 4 && (cp < 0x10000 || cp > 0x10FFFF)) return 0;
+    return len;
+}
+
+// Copies text into `out` as UTF-8 that GTK accepts. Files that are valid
+// UTF-8 are copied as they are; anything else is taken to be Windows-1252,
+// which is what the original tables were written in. NUL bytes become
+// U+FFFD either way. Returns true if the text had to be converted.
+inline bool text_to_utf8(const uint8_t* data, size_t size, std::string& out) {
+    static const uint16_t cp1252[32] = {
+        0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+        0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+    static const char replacement[] = "\xEF\xBF\xBD";
+
+    bool utf8 = true, clean = true;
+    for (size_t i = 0; i < size;) {
+        i += text_ascii_prefix(data + i, size - i);
+        if (i == size) break;
+        if (data[i] == 0) {
+            clean = false;
+            ++i;
+            continue;
+        }
+        size_t len = text_utf8_sequence(data + i, size - i);
+        if (len == 0) {
+            utf8 = false;
+            break;
+        }
+        i += len;
+    }
+    if (utf8 && clean) {
+        out.assign(reinterpret_cast<const char*>(data), size);
+        return false;
+    }
+
+    out.clear();
+    out.reserve(utf8 ? size + size / 8 : size + size / 4);
+    for (size_t i = 0; i < size;) {
+        size_t run = text_ascii_prefix(data + i, size - i);
+        out.append(reinterpret_cast<const char*>(data + i), run);
+        i += run;
+        if (i == size) break;
+        const uint8_t c = data[i];
+        if (c == 0) {
+            out.append(replacement, 3);
+            ++i;
+        } else if (utf8) {
+            size_t len = text_utf8_sequence(data + i, size - i);
+            out.append(reinterpret_cast<const char*>(data + i), len);
+            i += len;
+        } else {
+            uint32_t cp = c >= 0xA0 ? c : cp1252[c - 0x80];
+            if (cp < 0x800) {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+            } else {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            }
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+            ++i;
+        }
+    }
+    return !utf8;
+}
+
+// What a stretch of a table or mission file is, for highlighting.
+enum class TextStyle : uint8_t { Section, Field, SubField, Comment, String, Number };
+constexpr int text_style_count = 6;
+
+// A highlighted stretch within one line; column and length are in bytes,
+// which is how Gtk::TextBuffer::get_iter_at_line_index() counts.
+struct TextSpan {
+    uint32_t line;
+    uint32_t column;
+    uint32_t length;
+    TextStyle style;
+};
+
+// A `#Section` header (level 0) or a `$Name:` line (level 1).
+struct TextOutlineItem {
+    uint32_t line;
+    uint8_t level;
+    std::string label;
+};
+
+struct TextScan {
+    std::vector<TextSpan> spans; // in text order
+    std::vector<TextOutlineItem> outline;
+    uint32_t lines = 0;
+
+    size_t memory_usage() const {
+        size_t bytes = spans.capacity() * sizeof(TextSpan) + outline.capacity() * sizeof(TextOutlineItem);
+        for (const auto& item : outline)
+            bytes += item.label.capacity();
+        return bytes;
+    }
+};
+
+// Highlights and indexes FreeSpace table and mission syntax in one pass
+// over UTF-8 text: `#Section` lines, `$Field:` and `+SubField:` names,
+// `;`, `//` and `/* */` comments, quoted strings and numbers. Spans never
+// cross a line, so a block comment gives one span per line.
+inline TextScan text_scan(std::string_view text) {
+    TextScan scan;
+    const size_t max_label = 80;
+    auto is_word = [](char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+               static_cast<unsigned char>(c) >= 0x80;
+    };
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    // Where the comment starting at or after `from` begins; quoted strings
+    // are skipped, so `"a;b"` is not one.
+    auto comment_start = [](std::string_view s, size_t from) {
+        for (size_t k = from; k < s.size(); ++k) {
+            if (s[k] == '"') {
+                size_t close = s.find('"', k + 1);
+                if (close == std::string_view::npos) break;
+                k = close;
+            } else if (s[k] == ';' || (s[k] == '/' && k + 1 < s.size() && (s[k + 1] == '/' || s[k + 1] == '*'))) {
+                return k;
+            }
+        }
+        return s.size();
+    };
+    // Trimmed and cut to max_label bytes, not inside a UTF-8 sequence.
+    auto make_label = [&](std::string_view s) {
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+            s.remove_suffix(1);
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        if (s.size() > max_label) {
+            size_t cut = max_label;
+            while (cut > 0 && (static_cast<unsigned char>(s[cut]) & 0xC0) == 0x80)
+                --cut;
+            s = s.substr(0, cut);
+        }
+        return std::string(s);
+    };
+
+    bool in_block_comment = false;
+    uint32_t line = 0;
+    for (size_t line_start = 0; line_start <= text.size(); ++line) {
+        // Lines end as GtkTextBuffer ends them: at \n, \r\n or a lone \r.
+        size_t nl = text.find('\n', line_start);
+        if (size_t cr = text.substr(line_start, nl - line_start).find('\r'); cr != std::string_view::npos)
+            nl = line_start + cr;
+        size_t line_end = nl == std::string_view::npos ? text.size() : nl;
+        std::string_view s = text.substr(line_start, line_end - line_start);
+        auto add = [&](size_t from, size_t to, TextStyle style) {
+            if (to > from)
+                scan.spans.push_back({line, static_cast<uint32_t>(from), static_cast<uint32_t>(to - from), style});
+        };
+
+        size_t i = 0;
+        if (in_block_comment) {
+            size_t close = s.find("*/");
+            i = close == std::string_view::npos ? s.size() : close + 2;
+            add(0, i, TextStyle::Comment);
+            in_block_comment = close == std::string_view::npos;
+        }
+
+        size_t code_end = comment_start(s, i);
+        size_t first = i;
+        while (first < code_end && (s[first] == ' ' || s[first] == '\t'))
+            ++first;
+        if (first < code_end && s[first] == '#') {
+            size_t last = code_end;
+            while (last > first && (s[last - 1] == ' ' || s[last - 1] == '\t'))
+                --last;
+            add(first, last, TextStyle::Section);
+            std::string label = make_label(s.substr(first, last - first));
+            if (label.size() > 1 && !(label.size() == 4 && strncasecmp(label.c_str(), "#End", 4) == 0))
+                scan.outline.push_back({line, 0, std::move(label)});
+            i = code_end;
+        } else if (first < code_end && (s[first] == '$' || s[first] == '+')) {
+            size_t colon = s.substr(0, code_end).find(':', first);
+            if (colon != std::string_view::npos) {
+                add(first, colon + 1, s[first] == '$' ? TextStyle::Field : TextStyle::SubField);
+                std::string_view key = s.substr(first, colon + 1 - first);
+                if (key.size() == 6 && strncasecmp(key.data(), "$Name:", 6) == 0) {
+                    std::string label = make_label(s.substr(colon + 1, code_end - colon - 1));
+                    if (!label.empty())
+                        scan.outline.push_back({line, 1, std::move(label)});
+                }
+                i = colon + 1;
+            }
+        }
+
+        while (i < s.size()) {
+            char c = s[i];
+            if (i >= code_end) {
+                if (s.compare(i, 2, "/*") == 0) {
+                    size_t close = s.find("*/", i + 2);
+                    size_t end = close == std::string_view::npos ? s.size() : close + 2;
+                    add(i, end, TextStyle::Comment);
+                    in_block_comment = close == std::string_view::npos;
+                    i = end;
+                    // Code may follow a closed block comment.
+                    if (!in_block_comment)
+                        code_end = comment_start(s, i);
+                } else {
+                    add(i, s.size(), TextStyle::Comment);
+                    i = s.size();
+                }
+            } else if (c == '"') {
+                size_t close = s.find('"', i + 1);
+                size_t end = close == std::string_view::npos ? s.size() : close + 1;
+                add(i, end, TextStyle::String);
+                i = end;
+            } else if ((is_digit(c) || ((c == '-' || c == '.') && i + 1 < s.size() && is_digit(s[i + 1]))) &&
+                       (i == 0 || !is_word(s[i - 1]))) {
+                size_t end = i + 1;
+                while (end < s.size() && (is_digit(s[end]) || s[end] == '.'))
+                    ++end;
+                if (end < s.size() && is_word(s[end])) {
+                    while (end < s.size() && is_word(s[end]))
+                        ++end;
+                } else {
+                    add(i, end, TextStyle::Number);
+                }
+                i = end;
+            } else if (is_word(c)) {
+                // Digits inside a word are not numbers; skip it whole.
+                while (i < code_end && is_word(s[i]))
+                    ++i;
+            } else {
+                ++i;
+            }
+        }
+
+        if (nl == std::string_view::npos) break;
+        line_start = nl + (text.compare(nl, 2, "\r\n") == 0 ? 2 : 1);
+    }
+    scan.lines = line + 1;
+    return scan;
+}
@@ -0,0 +1,331 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include "pcx_decoder.h"
+
+struct TGAImage {
+    int width;
+    int height;
+    std::vector<uint8_t> rgba_data;
+};
+
+// How the pixels (or colour map entries) of a TGA are stored.
+enum class TGAPixelFormat { Indexed8, Gray8, GrayAlpha16, BGR555, BGR24, BGRA32 };
+
+struct TGAHeader {
+    int width;
+    int height;
+    bool rle;
+    TGAPixelFormat format;
+    int bytes_per_pixel;
+    bool alpha;           // 16-bit: the top bit is alpha; 32-bit: alpha declared
+    bool top_down;        // descriptor bit 5: first row is the top one
+    bool right_to_left;   // descriptor bit 4
+    size_t colormap_offset;
+    int colormap_first;
+    int colormap_length;
+    TGAPixelFormat colormap_format;
+    int colormap_bytes;
+    size_t data_offset;
+};
+
+// Validates the 18-byte header of an uncompressed or RLE true-colour,
+// colour-mapped (8-bit indices) or greyscale TGA.
+inline TGAHeader tga_parse_header(const uint8_t* data, size_t size) {
+    if (size < 18)
+        throw std::runtime_error("Data too small to be a valid TGA");
+    TGAHeader h{};
+    int id_length = data[0];
+    int colormap_type = data[1];
+    int image_type = data[2];
+    h.colormap_first = data[3] | (data[4] << 8);
+    h.colormap_length = data[5] | (data[6] << 8);
+    int colormap_bits = data[7];
+    h.width = data[12] | (data[13] << 8);
+    h.height = data[14] | (data[15] << 8);
+    int bits = data[16];
+    int descriptor = data[17];
+    if (colormap_type > 1 || h.width == 0 || h.height == 0)
+        throw std::runtime_error("Invalid TGA header");
+
+    h.rle = image_type >= 9;
+    int alpha_bits = descriptor & 0x0F;
+    h.top_down = (descriptor & 0x20) != 0;
+    h.right_to_left = (descriptor & 0x10) != 0;
+
+    auto colour_format = [](int bits, TGAPixelFormat& format) {
+        switch (bits) {
+        case 15: case 16: format = TGAPixelFormat::BGR555; return true;
+        case 24: format = TGAPixelFormat::BGR24; return true;
+        case 32: format = TGAPixelFormat::BGRA32; return true;
+        default: return false;
+        }
+    };
+    switch (image_type) {
+    case 1: case 9:
+        if (colormap_type != 1 || bits != 8 || !colour_format(colormap_bits, h.colormap_format))
+            throw std::runtime_error("Unsupported TGA colour map");
+        h.format = TGAPixelFormat::Indexed8;
+        break;
+    case 2: case 10:
+        if (!colour_format(bits, h.format))
+            throw std::runtime_error("Unsupported TGA pixel depth");
+        break;
+    case 3: case 11:
+        if (bits == 8) h.format = TGAPixelFormat::Gray8;
+        else if (bits == 16) h.format = TGAPixelFormat::GrayAlpha16;
+        else throw std::runtime_error("Unsupported TGA pixel depth");
+        break;
+    default:
+        throw std::runtime_error("Unsupported TGA image type");
+    }
+    h.bytes_per_pixel = (bits + 7) / 8;
+    h.alpha = h.format == TGAPixelFormat::BGR555 ? alpha_bits >= 1 : alpha_bits > 0;
+
+    h.colormap_offset = 18 + static_cast<size_t>(id_length);
+    h.colormap_bytes = colormap_type ? (colormap_bits + 7) / 8 : 0;
+    h.data_offset = h.colormap_offset + static_cast<size_t>(h.colormap_length) * h.colormap_bytes;
+    if (h.data_offset > size)
+        throw std::runtime_error("Truncated TGA header");
+    return h;
+}
+
+inline void tga_dimensions(const uint8_t* data, size_t size, int& width, int& height) {
+    TGAHeader h = tga_parse_header(data, size);
+    width = h.width;
+    height = h.height;
+}
+
+inline void tga_swizzle_bgr_scalar(const uint8_t* src, uint8_t* dst, int count) {
+    for (int i = 0; i < count; ++i, src += 3, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 255;
+    }
+}
+
+inline void tga_swizzle_bgra_scalar(const uint8_t* src, uint8_t* dst, int count) {
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// Four pixels per shuffle. A 16-byte load of BGR data covers five and a
+// third pixels, so the loop stops while a whole load still lies inside the
+// source and the scalar loop takes the last few.
+__attribute__((target("ssse3")))
+inline void tga_swizzle_bgr_ssse3(const uint8_t* src, uint8_t* dst, int count) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    int i = 0;
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+    }
+    tga_swizzle_bgr_scalar(src + i * 3, dst + i * 4, count - i);
+}
+
+__attribute__((target("ssse3")))
+inline void tga_swizzle_bgra_ssse3(const uint8_t* src, uint8_t* dst, int count) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(a, shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_shuffle_epi8(b, shuffle));
+    }
+    tga_swizzle_bgra_scalar(src + i * 4, dst + i * 4, count - i);
+}
+#endif
+
+inline void tga_swizzle_bgr(const uint8_t* src, uint8_t* dst, int count) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        tga_swizzle_bgr_ssse3(src, dst, count);
+        return;
+    }
+#endif
+    tga_swizzle_bgr_scalar(src, dst, count);
+}
+
+inline void tga_swizzle_bgra(const uint8_t* src, uint8_t* dst, int count) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        tga_swizzle_bgra_ssse3(src, dst, count);
+        return;
+    }
+#endif
+    tga_swizzle_bgra_scalar(src, dst, count);
+}
+
+// Converts `count` pixels of any non-indexed format to RGBA.
+inline void tga_convert(TGAPixelFormat format, bool alpha, const uint8_t* src, uint8_t* dst, int count) {
+    switch (format) {
+    case TGAPixelFormat::BGR24:
+        tga_swizzle_bgr(src, dst, count);
+        break;
+    case TGAPixelFormat::BGRA32:
+        tga_swizzle_bgra(src, dst, count);
+        break;
+    case TGAPixelFormat::BGR555:
+        for (int i = 0; i < count; ++i, src += 2, dst += 4) {
+            unsigned v = src[0] | (src[1] << 8);
+            unsigned r = (v >> 10) & 31, g = (v >> 5) & 31, b = v & 31;
+            dst[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+            dst[1] = static_cast<uint8_t>((g << 3) | (g >> 2));
+            dst[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+            dst[3] = !alpha || (v & 0x8000) ? 255 : 0;
+        }
+        break;
+    case TGAPixelFormat::Gray8:
+        for (int i = 0; i < count; ++i, ++src, dst += 4) {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = 255;
+        }
+        break;
+    case TGAPixelFormat::GrayAlpha16:
+        for (int i = 0; i < count; ++i, src += 2, dst += 4) {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = src[1];
+        }
+        break;
+    case TGAPixelFormat::Indexed8:
+        break; // expanded through the colour map LUT instead
+    }
+}
+
+// Decodes a TGA straight into `dst`: `height` rows of `width` RGBA pixels,
+// `stride` bytes apart (stride >= width * 4), flipped upright whatever the
+// file's origin. Nothing is allocated. Raw pixels go through the SIMD
+// swizzle (or the colour map LUT) a row segment at a time; an RLE run packet
+// converts its pixel once and fills. Packets may cross rows, as the format
+// allows. A 32-bit image that declares no alpha bits and whose alpha is
+// zero everywhere is made opaque, as older tools wrote such files.
+inline void decode_tga_into(const uint8_t* data, size_t size, uint8_t* dst, size_t stride) {
+    const TGAHeader h = tga_parse_header(data, size);
+    const int width = h.width, height = h.height, bpp = h.bytes_per_pixel;
+
+    uint32_t lut[256] = {};
+    if (h.format == TGAPixelFormat::Indexed8) {
+        for (int i = 0; i < h.colormap_length; ++i) {
+            int index = h.colormap_first + i;
+            if (index > 255) break;
+            tga_convert(h.colormap_format, h.alpha, data + h.colormap_offset + static_cast<size_t>(i) * h.colormap_bytes,
+                        reinterpret_cast<uint8_t*>(&lut[index]), 1);
+        }
+    }
+    auto convert = [&](const uint8_t* src, uint8_t* out, int count) {
+        if (h.format == TGAPixelFormat::Indexed8)
+            pcx_expand(src, out, count, lut);
+        else
+            tga_convert(h.format, h.alpha, src, out, count);
+    };
+    auto row_at = [&](int y) {
+        return dst + static_cast<size_t>(h.top_down ? y : height - 1 - y) * stride;
+    };
+
+    const uint8_t* pos = data + h.data_offset;
+    const uint8_t* end = data + size;
+    int y = 0;
+    if (!h.rle) {
+        const size_t row_bytes = static_cast<size_t>(width) * bpp;
+        for (; y < height && static_cast<size_t>(end - pos) >= row_bytes; ++y, pos += row_bytes)
+            convert(pos, row_at(y), width);
+    } else {
+        int x = 0;
+        uint8_t* row = row_at(0);
+        while (y < height && pos < end) {
+            uint8_t packet = *pos++;
+            int count = (packet & 0x7F) + 1;
+            if (packet & 0x80) {
+                if (end - pos < bpp)
+                    throw std::runtime_error("Unexpected end of data");
+                uint32_t pixel = 0;
+                convert(pos, reinterpret_cast<uint8_t*>(&pixel), 1);
+                pos += bpp;
+                while (count > 0 && y < height) {
+                    int n = std::min(count, width - x);
+                    std::fill_n(reinterpret_cast<uint32_t*>(row) + x, n, pixel);
+                    x += n;
+                    count -= n;
+                    if (x == width && ++y < height) {
+                        x = 0;
+                        row = row_at(y);
+                    }
+                }
+            } else {
+                if (end - pos < static_cast<ptrdiff_t>(count) * bpp)
+                    throw std::runtime_error("Unexpected end of data");
+                while (count > 0 && y < height) {
+                    int n = std::min(count, width - x);
+                    convert(pos, row + static_cast<size_t>(x) * 4, n);
+                    pos += static_cast<size_t>(n) * bpp;
+                    x += n;
+                    count -= n;
+                    if (x == width && ++y < height) {
+                        x = 0;
+                        row = row_at(y);
+                    }
+                }
+            }
+        }
+        // A partly decoded last row keeps its pixels; the rest is cleared below.
+        if (y < height && x > 0) {
+            std::memset(row + static_cast<size_t>(x) * 4, 0, static_cast<size_t>(width - x) * 4);
+            ++y;
+        }
+    }
+    for (; y < height; ++y)
+        std::memset(row_at(y), 0, static_cast<size_t>(width) * 4);
+
+    if (h.right_to_left) {
+        for (int r = 0; r < height; ++r) {
+            uint32_t* p = reinterpret_cast<uint32_t*>(dst + static_cast<size_t>(r) * stride);
+            std::reverse(p, p + width);
+        }
+    }
+
+    const bool has_alpha_channel = h.format == TGAPixelFormat::BGRA32 ||
+                                   (h.format == TGAPixelFormat::Indexed8 && h.colormap_format == TGAPixelFormat::BGRA32);
+    if (has_alpha_channel && !h.alpha) {
+        bool any_alpha = false;
+        for (int r = 0; r < height && !any_alpha; ++r) {
+            const uint8_t* p = dst + static_cast<size_t>(r) * stride;
+            for (int i = 0; i < width; ++i)
+                any_alpha |= p[i * 4 + 3] != 0;
+        }
+        if (!any_alpha)
+            for (int r = 0; r < height; ++r) {
+                uint8_t* p = dst + static_cast<size_t>(r) * stride;
+                for (int i = 0; i < width; ++i)
+                    p[i * 4 + 3] = 255;
+            }
+    }
+}
+
+inline TGAImage load_tga_from_memory(const uint8_t* bytes, size_t size) {
+    TGAImage image;
+    tga_dimensions(bytes, size, image.width, image.height);
+    image.rgba_data.resize(static_cast<size_t>(image.width) * image.height * 4);
+    decode_tga_into(bytes, size, image.rgba_data.data(), static_cast<size_t>(image.width) * 4);
+    return image;
+}
+
+inline TGAImage load_tga_from_memory(const std::vector<uint8_t>& data) {
+    return load_tga_from_memory(data.data(), data.size());
+}
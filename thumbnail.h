@@ -0,0 +1,266 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#include <unistd.h>
+#endif
+#include "vp_parser.h"
+
+// A small straight-alpha RGBA image, rows tightly packed.
+struct Thumbnail {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+// Area (box) filter from RGB or RGBA rows to a smaller RGBA image. Every
+// destination pixel averages the block of source pixels it covers, weighted
+// by alpha so transparent pixels don't bleed their colour into the edges.
+//
+// Rows are summed into one 32-bit accumulator per channel, then adjacent
+// columns of that row are summed per destination pixel; with SSE2 one
+// pixel's four sums are one register in both passes.
+inline void box_downscale(const uint8_t* src, int src_width, int src_height, size_t src_stride, int channels,
+                          uint8_t* dst, int dst_width, int dst_height, size_t dst_stride) {
+    // A block's alpha-weighted sum has to fit in a signed 32-bit lane
+    // (255 * 255 per pixel), which holds up to 128x128 source pixels.
+    // Larger reductions go through an intermediate image.
+    const int max_ratio = 128;
+    if (src_width > dst_width * max_ratio || src_height > dst_height * max_ratio) {
+        int mid_width = std::min(src_width, dst_width * max_ratio / 2);
+        int mid_height = std::min(src_height, dst_height * max_ratio / 2);
+        std::vector<uint8_t> mid(static_cast<size_t>(mid_width) * mid_height * 4);
+        box_downscale(src, src_width, src_height, src_stride, channels, mid.data(), mid_width, mid_height,
+                      static_cast<size_t>(mid_width) * 4);
+        box_downscale(mid.data(), mid_width, mid_height, static_cast<size_t>(mid_width) * 4, 4, dst, dst_width,
+                      dst_height, dst_stride);
+        return;
+    }
+
+    std::vector<uint32_t> acc(static_cast<size_t>(src_width) * 4);
+    for (int y = 0; y < dst_height; ++y) {
+        const int y0 = static_cast<int>(static_cast<int64_t>(y) * src_height / dst_height);
+        const int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * src_height / dst_height));
+        std::fill(acc.begin(), acc.end(), 0u);
+
+        for (int sy = y0; sy < y1; ++sy) {
+            const uint8_t* row = src + src_stride * sy;
+            int x = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+            if (channels == 4) {
+                // Four pixels at a time: widen to 16 bits, multiply r, g, b
+                // by their pixel's alpha (and alpha by one), widen to 32.
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+                const __m128i alpha_one = _mm_set_epi16(1, 0, 0, 0, 1, 0, 0, 0);
+                __m128i* sums = reinterpret_cast<__m128i*>(acc.data());
+                for (; x + 4 <= src_width; x += 4) {
+                    __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 4 * x));
+                    __m128i halves[2] = {_mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero)};
+                    for (int h = 0; h < 2; ++h) {
+                        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+                        a = _mm_or_si128(_mm_andnot_si128(alpha_lanes, a), alpha_one);
+                        __m128i weighted = _mm_mullo_epi16(halves[h], a);
+                        __m128i* s = sums + x + 2 * h;
+                        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), _mm_unpacklo_epi16(weighted, zero)));
+                        _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(weighted, zero)));
+                    }
+                }
+            }
+#endif
+            for (; x < src_width; ++x) {
+                const uint8_t* p = row + static_cast<size_t>(x) * channels;
+                uint32_t a = channels == 4 ? p[3] : 255;
+                uint32_t* s = &acc[static_cast<size_t>(x) * 4];
+                s[0] += p[0] * a;
+                s[1] += p[1] * a;
+                s[2] += p[2] * a;
+                s[3] += a;
+            }
+        }
+
+        uint8_t* out = dst + dst_stride * y;
+        for (int x = 0; x < dst_width; ++x) {
+            const int x0 = static_cast<int>(static_cast<int64_t>(x) * src_width / dst_width);
+            const int x1 = std::max(x0 + 1, static_cast<int>(static_cast<int64_t>(x + 1) * src_width / dst_width));
+            const float count = static_cast<float>((x1 - x0) * (y1 - y0));
+#if defined(__x86_64__) && defined(__GNUC__)
+            const __m128i* sums = reinterpret_cast<const __m128i*>(acc.data());
+            __m128i sum = _mm_setzero_si128();
+            for (int sx = x0; sx < x1; ++sx)
+                sum = _mm_add_epi32(sum, _mm_loadu_si128(sums + sx));
+            // Colour divides by the alpha sum (undoing the weighting),
+            // alpha by the pixel count.
+            __m128 v = _mm_cvtepi32_ps(sum);
+            __m128 alpha_sum = _mm_max_ps(_mm_shuffle_ps(v, v, 0xFF), _mm_set1_ps(1.0f));
+            __m128 alpha_lane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+            __m128 divisor = _mm_or_ps(_mm_and_ps(alpha_lane, _mm_set1_ps(count)), _mm_andnot_ps(alpha_lane, alpha_sum));
+            __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(v, divisor), _mm_set1_ps(0.5f)));
+            q = _mm_packus_epi16(_mm_packs_epi32(q, q), q);
+            uint32_t pixel = static_cast<uint32_t>(_mm_cvtsi128_si32(q));
+            std::memcpy(out + 4 * x, &pixel, 4);
+#else
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for (int sx = x0; sx < x1; ++sx)
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += acc[static_cast<size_t>(sx) * 4 + c];
+            float alpha_sum = std::max(static_cast<float>(sum[3]), 1.0f);
+            for (int c = 0; c < 3; ++c)
+                out[4 * x + c] = static_cast<uint8_t>(static_cast<float>(sum[c]) / alpha_sum + 0.5f);
+            out[4 * x + 3] = static_cast<uint8_t>(static_cast<float>(sum[3]) / count + 0.5f);
+#endif
+        }
+    }
+}
+
+// Scales an image to fit in max_size x max_size, keeping its aspect ratio.
+// Images that already fit keep their size.
+inline Thumbnail make_thumbnail(const uint8_t* src, int width, int height, size_t stride, int channels, int max_size) {
+    Thumbnail thumb;
+    if (width <= 0 || height <= 0) return thumb;
+    if (width <= max_size && height <= max_size) {
+        thumb.width = width;
+        thumb.height = height;
+    } else if (width >= height) {
+        thumb.width = max_size;
+        thumb.height = std::max(1, static_cast<int>((static_cast<int64_t>(height) * max_size + width / 2) / width));
+    } else {
+        thumb.height = max_size;
+        thumb.width = std::max(1, static_cast<int>((static_cast<int64_t>(width) * max_size + height / 2) / height));
+    }
+    thumb.rgba.resize(static_cast<size_t>(thumb.width) * thumb.height * 4);
+    box_downscale(src, width, height, stride, channels, thumb.rgba.data(), thumb.width, thumb.height,
+                  static_cast<size_t>(thumb.width) * 4);
+    return thumb;
+}
+
+// Thumbnails on disk, one small file each, named by a hash of the archive's
+// absolute path, the entry's offset, size and timestamp, and the thumbnail
+// size. A changed or moved entry simply hashes to a different file, so the
+// cache never has to be invalidated. Files are written under a temporary
+// name and renamed, so concurrent writers (threads or processes) never
+// expose a partial file. All methods are safe to call from several threads.
+class ThumbnailDiskCache {
+public:
+    explicit ThumbnailDiskCache(std::string dir = default_dir()) : m_dir(std::move(dir)) {}
+
+    // $VPVIEW_THUMB_CACHE, else $XDG_CACHE_HOME/vpview/thumbnails, else
+    // ~/.cache/vpview/thumbnails. Empty (disabling the cache) if none is set.
+    static std::string default_dir() {
+        if (const char* env = std::getenv("VPVIEW_THUMB_CACHE"))
+            return env;
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+            return std::string(xdg) + "/vpview/thumbnails";
+        if (const char* home = std::getenv("HOME"); home && *home)
+            return std::string(home) + "/.cache/vpview/thumbnails";
+        return "";
+    }
+
+    // The archive part of the key; resolve it once per archive.
+    static std::string archive_id(const std::string& filename) {
+        std::error_code ec;
+        auto path = std::filesystem::weakly_canonical(filename, ec);
+        return ec ? filename : path.string();
+    }
+
+    static uint64_t key(const std::string& archive_id, const VPEntry& entry, int max_size) {
+        uint64_t h = 1469598103934665603ull; // FNV-1a
+        auto mix = [&h](const void* data, size_t size) {
+            const auto* p = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                h ^= p[i];
+                h *= 1099511628211ull;
+            }
+        };
+        mix(archive_id.data(), archive_id.size());
+        const int32_t fields[4] = {entry.offset, entry.size, entry.timestamp, max_size};
+        mix(fields, sizeof(fields));
+        return h;
+    }
+
+    bool enabled() const { return !m_dir.empty(); }
+
+    bool load(uint64_t key, Thumbnail& thumb) const {
+        if (!enabled()) return false;
+        std::ifstream in(path_of(key), std::ios::binary);
+        if (!in) return false;
+        Header header{};
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        if (std::memcmp(header.magic, "VPTH", 4) != 0 || header.version != 1 || header.key != key ||
+            header.width == 0 || header.height == 0)
+            return false;
+        thumb.width = header.width;
+        thumb.height = header.height;
+        thumb.rgba.resize(static_cast<size_t>(thumb.width) * thumb.height * 4);
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(thumb.rgba.data()), thumb.rgba.size()));
+    }
+
+    bool store(uint64_t key, const Thumbnail& thumb) const {
+        if (!enabled() || thumb.width <= 0 || thumb.height <= 0 || thumb.width > 0xFFFF || thumb.height > 0xFFFF)
+            return false;
+        std::error_code ec;
+        std::filesystem::create_directories(m_dir, ec);
+        std::string path = path_of(key);
+        // mkstemp gives every writer, in this process or another viewer, its
+        // own temp file; rename() then replaces the entry atomically.
+        std::string tmp = path + ".tmpXXXXXX";
+        int fd = mkstemp(tmp.data());
+        if (fd < 0) return false;
+        Header header{};
+        std::memcpy(header.magic, "VPTH", 4);
+        header.version = 1;
+        header.width = static_cast<uint16_t>(thumb.width);
+        header.height = static_cast<uint16_t>(thumb.height);
+        header.key = key;
+        bool ok = write_all(fd, &header, sizeof(header)) && write_all(fd, thumb.rgba.data(), thumb.rgba.size());
+        if (::close(fd) != 0 || !ok) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static bool write_all(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint16_t width;
+        uint16_t height;
+        uint32_t reserved;
+        uint64_t key;
+    };
+
+    std::string path_of(uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.thumb", static_cast<unsigned long long>(key));
+        return m_dir + "/" + name;
+    }
+
+    std::string m_dir;
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include <gtkmm.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "dds_decoder.h"
+#include "pcx_decoder.h"
+#include "preview_worker.h"
+#include "tga_decoder.h"
+#include "thumbnail.h"
+#include "vp_parser.h"
+#include "vp_trace.h"
+
+struct ThumbnailJob {
+    PreviewKind kind = PreviewKind::Image;
+    const VPParser* parser = nullptr;
+    VPEntry entry{};
+    uint32_t node = 0; // VPVFS node, handed back in the result
+};
+
+struct ThumbnailResult {
+    uint32_t node = 0;
+    Thumbnail thumb; // empty if the entry could not be decoded
+    bool from_disk = false;
+};
+
+struct ThumbnailStats {
+    size_t files = 0;
+    size_t from_disk = 0;
+    size_t failed = 0;
+    double seconds = 0.0;
+    bool cancelled = false;
+};
+
+// Builds the thumbnails of a batch of entries on a pool of threads, like
+// vp_extract(): entries are sorted by (archive, offset) and handed out a few
+// at a time, so each archive is read close to sequentially. Each entry is
+// first looked up in the disk cache; only misses are read, decoded (small
+// DDS mip levels where there are any), box-filtered and written back.
+//
+// Results are collected as they finish and announced on the GTK main loop
+// through signal_ready(); start() and cancel_and_wait() drop whatever the
+// previous batch had not delivered yet.
+class ThumbnailLoader {
+public:
+    explicit ThumbnailLoader(int size = 128) : m_size(size) {}
+    ~ThumbnailLoader() { cancel_and_wait(); }
+
+    int size() const { return m_size; }
+    Glib::Dispatcher& signal_ready() { return m_ready; }
+
+    void start(std::vector<ThumbnailJob> jobs) {
+        cancel_and_wait();
+        m_cancel = false;
+        m_thread = std::thread([this, jobs = std::move(jobs)]() mutable { run(std::move(jobs)); });
+    }
+
+    // Stops the batch and waits for the threads. Call before the archives
+    // the jobs point into go away.
+    void cancel_and_wait() {
+        if (m_thread.joinable()) {
+            m_cancel = true;
+            m_thread.join();
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results.clear();
+        m_finished = false;
+    }
+
+    std::vector<ThumbnailResult> take_results() {
+        std::vector<ThumbnailResult> results;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        results.swap(m_results);
+        return results;
+    }
+
+    // True once, after the last result of a batch has been taken.
+    bool take_finished(ThumbnailStats& stats) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_finished || !m_results.empty()) return false;
+        m_finished = false;
+        stats = m_stats;
+        return true;
+    }
+
+    // Decodes one entry's image and scales it to fit size x size. Throws on
+    // data the decoders reject.
+    static Thumbnail decode(PreviewKind kind, const uint8_t* data, size_t size, int thumb_size) {
+        switch (kind) {
+        case PreviewKind::PCX: {
+            int width, height;
+            pcx_dimensions(data, size, width, height);
+            std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+            decode_pcx_into(data, size, rgba.data(), static_cast<size_t>(width) * 4);
+            return make_thumbnail(rgba.data(), width, height, static_cast<size_t>(width) * 4, 4, thumb_size);
+        }
+        case PreviewKind::TGA: {
+            int width, height;
+            tga_dimensions(data, size, width, height);
+            std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+            decode_tga_into(data, size, rgba.data(), static_cast<size_t>(width) * 4);
+            return make_thumbnail(rgba.data(), width, height, static_cast<size_t>(width) * 4, 4, thumb_size);
+        }
+        case PreviewKind::DDS: {
+            DDSInfo info = dds_parse(data, size);
+            int level = dds_pick_level(info, thumb_size, thumb_size);
+            int width = dds_level_width(info, level), height = dds_level_height(info, level);
+            std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+            decode_dds_into(info, data, size, level, rgba.data(), static_cast<size_t>(width) * 4, 1);
+            return make_thumbnail(rgba.data(), width, height, static_cast<size_t>(width) * 4, 4, thumb_size);
+        }
+        default: {
+            auto loader = Gdk::PixbufLoader::create();
+            loader->write(data, size);
+            loader->close();
+            auto pixbuf = loader->get_pixbuf();
+            if (!pixbuf)
+                throw std::runtime_error("no image");
+            return make_thumbnail(pixbuf->get_pixels(), pixbuf->get_width(), pixbuf->get_height(),
+                                  pixbuf->get_rowstride(), pixbuf->get_n_channels(), thumb_size);
+        }
+        }
+    }
+
+private:
+    void run(std::vector<ThumbnailJob> jobs) {
+        auto start = std::chrono::steady_clock::now();
+        std::sort(jobs.begin(), jobs.end(), [](const ThumbnailJob& a, const ThumbnailJob& b) {
+            if (a.parser != b.parser) return a.parser < b.parser;
+            return a.entry.offset < b.entry.offset;
+        });
+        std::map<const VPParser*, std::string> archive_ids;
+        for (const auto& job : jobs)
+            if (!archive_ids.count(job.parser))
+                archive_ids[job.parser] = ThumbnailDiskCache::archive_id(job.parser->filename);
+
+        const ThumbnailDiskCache disk;
+        unsigned threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, jobs.size() / 4)));
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> from_disk{0};
+        std::atomic<size_t> failed{0};
+        const size_t batch = 8;
+
+        auto worker = [&]() {
+            std::vector<uint8_t> scratch;
+            std::vector<ThumbnailResult> done;
+            for (;;) {
+                size_t first = next.fetch_add(batch);
+                if (first >= jobs.size()) return;
+                size_t last = std::min(first + batch, jobs.size());
+                for (size_t k = first; k < last && !m_cancel; ++k) {
+                    const ThumbnailJob& job = jobs[k];
+                    ThumbnailResult result;
+                    result.node = job.node;
+                    uint64_t key = ThumbnailDiskCache::key(archive_ids.at(job.parser), job.entry, m_size);
+                    if (disk.load(key, result.thumb)) {
+                        result.from_disk = true;
+                        ++from_disk;
+                    } else {
+                        VPTraceScope trace("thumbnail");
+                        trace.set_bytes(job.entry.size);
+                        trace.set_detail(job.entry.full_path);
+                        VPView data = job.parser->read(job.entry, scratch);
+                        try {
+                            if (data.empty()) throw std::runtime_error("out of bounds");
+                            result.thumb = decode(job.kind, data.data, data.size, m_size);
+                            disk.store(key, result.thumb);
+                        } catch (...) {
+                            result.thumb = Thumbnail();
+                            ++failed;
+                        }
+                    }
+                    done.push_back(std::move(result));
+                }
+                if (m_cancel) return;
+                deliver(done);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+            pool.emplace_back([&]() {
+                vp_trace_name_thread("thumbnail worker");
+                worker();
+            });
+        vp_trace_name_thread("thumbnail worker");
+        worker();
+        for (auto& t : pool)
+            t.join();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.files = jobs.size();
+            m_stats.from_disk = from_disk;
+            m_stats.failed = failed;
+            m_stats.cancelled = m_cancel;
+            m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            m_finished = true;
+        }
+        m_ready.emit();
+    }
+
+    // Hands a finished batch to the main thread; only the first batch after
+    // the main thread last took results wakes it.
+    void deliver(std::vector<ThumbnailResult>& done) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            wake = m_results.empty();
+            for (auto& r : done)
+                m_results.push_back(std::move(r));
+        }
+        done.clear();
+        if (wake) m_ready.emit();
+    }
+
+    int m_size;
+    std::thread m_thread;
+    std::atomic<bool> m_cancel{false};
+    std::mutex m_mutex;
+    std::vector<ThumbnailResult> m_results;
+    ThumbnailStats m_stats;
+    bool m_finished = false;
+    Glib::Dispatcher m_ready;
+};
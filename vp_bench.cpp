@@ -0,0 +1,634 @@
+// Standalone benchmarks for the archive and decoder hot paths. Needs no GTK:
+//
+//   make bench
+//   ./vp_bench --entries 20000 --max-size 65536 --pcx 1024x768 > bench.json
+//
+// A synthetic VP archive and PCX image are generated in a temporary
+// directory, every case is timed, and the results are printed as JSON.
+// `make bench-pixbuf` also times gdk-pixbuf's TGA loader for comparison.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#ifdef VP_BENCH_PIXBUF
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
+#include "ani_decoder.h"
+#include "dds_decoder.h"
+#include "pcx_decoder.h"
+#include "pof_decoder.h"
+#include "pof_render.h"
+#include "text_scan.h"
+#include "tga_decoder.h"
+#include "thumbnail.h"
+#include "vp_diff.h"
+#include "vp_extract.h"
+#include "vp_parser.h"
+#include "vp_trace.h"
+#include "vp_verify.h"
+#include "vp_writer.h"
+
+struct BenchConfig {
+    int entries = 10000;
+    int files_per_dir = 100;
+    int max_size = 16384;
+    int pcx_width = 640;
+    int pcx_height = 480;
+    int reads = 100000;
+    double min_seconds = 0.5;
+    unsigned seed = 1;
+};
+
+struct BenchResult {
+    std::string name;
+    long iterations = 0;
+    double ns_per_op = 0.0;
+    double mb_per_s = 0.0;
+    double ops_per_s = 0.0;
+    long peak_rss_kb = 0;
+};
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Calls `op` until at least min_seconds have passed. `op` returns how many
+// bytes it processed and how many operations it performed (e.g. one load,
+// or a batch of reads); ns_per_op and ops_per_s are per operation.
+static BenchResult run_bench(const std::string& name, const BenchConfig& config,
+                             const std::function<std::pair<uint64_t, uint64_t>()>& op) {
+    BenchResult r;
+    r.name = name;
+    uint64_t bytes = 0, ops = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        auto [b, n] = op();
+        bytes += b;
+        ops += n;
+        ++r.iterations;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < config.min_seconds);
+    r.ns_per_op = ops ? elapsed * 1e9 / ops : 0.0;
+    r.mb_per_s = bytes / (1024.0 * 1024.0) / elapsed;
+    r.ops_per_s = ops / elapsed;
+    r.peak_rss_kb = peak_rss_kb();
+    return r;
+}
+
+// Writes a VP archive with `entries` files of random size spread over
+// directories of files_per_dir entries each. Returns the payload size.
+static uint64_t write_synthetic_vp(const std::string& path, const BenchConfig& config) {
+    std::mt19937 rng(config.seed);
+    std::uniform_int_distribution<int> size_dist(1, config.max_size);
+
+    struct Record {
+        int32_t offset, size;
+        char name[32];
+        int32_t timestamp;
+    };
+    std::vector<Record> dir;
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return 0;
+    char header[16] = {'V', 'P', 'V', 'P'};
+    std::fwrite(header, 1, sizeof(header), out);
+
+    std::vector<char> payload(config.max_size);
+    for (auto& c : payload) c = static_cast<char>(rng());
+    uint64_t offset = sizeof(header);
+    auto add = [&](const std::string& name, int32_t size) {
+        Record rec{};
+        rec.offset = static_cast<int32_t>(offset);
+        rec.size = size;
+        std::strncpy(rec.name, name.c_str(), sizeof(rec.name) - 1);
+        rec.timestamp = 1000000000;
+        dir.push_back(rec);
+    };
+
+    add("data", 0);
+    for (int i = 0; i < config.entries; ++i) {
+        if (i % config.files_per_dir == 0) {
+            if (i > 0) add("..", 0);
+            add("dir" + std::to_string(i / config.files_per_dir), 0);
+        }
+        int size = size_dist(rng);
+        add("file" + std::to_string(i) + ".bin", size);
+        std::fwrite(payload.data(), 1, size, out);
+        offset += size;
+    }
+    add("..", 0);
+    add("..", 0);
+
+    int32_t fields[3] = {2, static_cast<int32_t>(offset), static_cast<int32_t>(dir.size())};
+    for (const auto& rec : dir) {
+        std::fwrite(&rec.offset, 4, 1, out);
+        std::fwrite(&rec.size, 4, 1, out);
+        std::fwrite(rec.name, 1, 32, out);
+        std::fwrite(&rec.timestamp, 4, 1, out);
+    }
+    std::fseek(out, 4, SEEK_SET);
+    std::fwrite(fields, 4, 3, out);
+    std::fclose(out);
+    return offset - sizeof(header);
+}
+
+// An 8-bit RLE PCX with a mix of runs and literals and a #00FF00 entry.
+static std::vector<uint8_t> make_synthetic_pcx(int width, int height, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(128, 0);
+    int bytes_per_line = width + (width & 1);
+    data[0] = 0x0A; data[1] = 5; data[2] = 1; data[3] = 8;
+    data[8] = (width - 1) & 0xFF; data[9] = (width - 1) >> 8;
+    data[10] = (height - 1) & 0xFF; data[11] = (height - 1) >> 8;
+    data[66] = bytes_per_line & 0xFF; data[67] = bytes_per_line >> 8;
+    for (int y = 0; y < height; ++y) {
+        int x = 0;
+        while (x < bytes_per_line) {
+            if (rng() % 3 == 0) {
+                int count = 1 + static_cast<int>(rng() % std::min(63, bytes_per_line - x));
+                data.push_back(0xC0 | count);
+                data.push_back(static_cast<uint8_t>(rng()));
+                x += count;
+            } else {
+                data.push_back(static_cast<uint8_t>(rng() % 0xC0));
+                ++x;
+            }
+        }
+    }
+    data.push_back(0x0C);
+    for (int i = 0; i < 768; ++i) data.push_back(static_cast<uint8_t>(rng()));
+    size_t green = data.size() - 768 + 7 * 3;
+    data[green] = 0x00; data[green + 1] = 0xFF; data[green + 2] = 0x00;
+    return data;
+}
+
+// A version 2 ANI: one STD_RLE keyframe, then STD_RLE delta frames in which
+// a moving band changes and the rest is left as ANI_UNCHANGED. Returns the
+// file and, in `frames`, the palette indices every frame should decode to.
+static std::vector<uint8_t> make_synthetic_ani(int width, int height, int count, unsigned seed,
+                                               std::vector<std::vector<uint8_t>>* frames = nullptr) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> out;
+    auto put16 = [&](int v) { out.push_back(v & 0xFF); out.push_back((v >> 8) & 0xFF); };
+    auto put32 = [&](int v) { put16(v & 0xFFFF); put16((v >> 16) & 0xFFFF); };
+    put16(0); put16(2); put16(15);
+    out.push_back(0); out.push_back(255); out.push_back(0);
+    put16(width); put16(height); put16(count);
+    out.push_back(0xEE); // packer_code, unused by STD_RLE
+    for (int i = 0; i < 768; ++i) out.push_back(static_cast<uint8_t>(rng()));
+    put16(1); put16(1); put32(0);
+    size_t size_at = out.size();
+    put32(0);
+    size_t data_start = out.size();
+
+    size_t total = size_t(width) * height;
+    std::vector<uint8_t> image(total), encoded(total);
+    // Runs of up to 127 copies of `encoded`; ANI_UNCHANGED stands for itself
+    // in keyframes and for "keep" in delta frames.
+    auto emit = [&](uint8_t method) {
+        out.push_back(method);
+        for (size_t x = 0; x < total;) {
+            size_t run = 1;
+            while (x + run < total && run < 127 && encoded[x + run] == encoded[x]) ++run;
+            if (run > 1 || (encoded[x] & ANI_STD_RLE_CODE)) {
+                out.push_back(static_cast<uint8_t>(ANI_STD_RLE_CODE | run));
+                out.push_back(encoded[x]);
+            } else {
+                out.push_back(encoded[x]);
+            }
+            x += run;
+        }
+    };
+    for (int f = 0; f < count; ++f) {
+        if (f == 0) {
+            for (size_t i = 0; i < total; ++i)
+                image[i] = encoded[i] = static_cast<uint8_t>(rng() % 4 ? i / 37 % 250 : rng() % 250);
+            emit(ANI_PACK_STD_RLE_KEY);
+        } else {
+            std::fill(encoded.begin(), encoded.end(), ANI_UNCHANGED);
+            int band = height / 8 + 1;
+            int top = (f * 3) % height;
+            for (int y = top; y < std::min(height, top + band); ++y)
+                for (int x = 0; x < width; ++x) {
+                    size_t i = size_t(y) * width + x;
+                    image[i] = encoded[i] = static_cast<uint8_t>((x / 5 + f) % 250);
+                }
+            emit(ANI_PACK_STD_RLE);
+        }
+        if (frames) frames->push_back(image);
+    }
+    int data_size = static_cast<int>(out.size() - data_start);
+    for (int i = 0; i < 4; ++i) out[size_at + i] = (data_size >> (8 * i)) & 0xFF;
+    return out;
+}
+
+// A POF holding one OBJ2 subobject: a UV sphere of rings * segments quads
+// stored as TMAPPOLY blocks after a single DEFPOINTS block.
+static std::vector<uint8_t> make_synthetic_pof(int rings, int segments) {
+    std::vector<uint8_t> out;
+    auto put32 = [](std::vector<uint8_t>& v, int32_t x) { uint8_t b[4]; std::memcpy(b, &x, 4); v.insert(v.end(), b, b + 4); };
+    auto putf = [](std::vector<uint8_t>& v, float x) { uint8_t b[4]; std::memcpy(b, &x, 4); v.insert(v.end(), b, b + 4); };
+    auto put16 = [](std::vector<uint8_t>& v, int16_t x) { uint8_t b[2]; std::memcpy(b, &x, 2); v.insert(v.end(), b, b + 2); };
+    auto putv = [&](std::vector<uint8_t>& v, float x, float y, float z) { putf(v, x); putf(v, y); putf(v, z); };
+    auto chunk = [&](const char* id, const std::vector<uint8_t>& body) {
+        out.insert(out.end(), id, id + 4);
+        put32(out, static_cast<int32_t>(body.size()));
+        out.insert(out.end(), body.begin(), body.end());
+    };
+
+    std::vector<uint8_t> bsp;
+    int n_verts = (rings + 1) * segments;
+    put32(bsp, POF_BSP_DEFPOINTS);
+    int header = 20 + n_verts;
+    put32(bsp, header + n_verts * 12);
+    put32(bsp, n_verts);
+    put32(bsp, 0);
+    put32(bsp, header);
+    bsp.insert(bsp.end(), n_verts, 0);
+    for (int r = 0; r <= rings; ++r)
+        for (int s = 0; s < segments; ++s) {
+            float theta = 3.14159265f * r / rings, phi = 6.2831853f * s / segments;
+            putv(bsp, 100 * std::sin(theta) * std::cos(phi), 100 * std::cos(theta), 100 * std::sin(theta) * std::sin(phi));
+        }
+    for (int r = 0; r < rings; ++r)
+        for (int s = 0; s < segments; ++s) {
+            int quad[4] = {r * segments + s, r * segments + (s + 1) % segments,
+                           (r + 1) * segments + (s + 1) % segments, (r + 1) * segments + s};
+            float theta = 3.14159265f * (r + 0.5f) / rings, phi = 6.2831853f * (s + 0.5f) / segments;
+            put32(bsp, POF_BSP_TMAPPOLY);
+            put32(bsp, 44 + 4 * 12);
+            putv(bsp, std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            putv(bsp, 0, 0, 0);
+            putf(bsp, 1);
+            put32(bsp, 4);
+            put32(bsp, 0);
+            for (int v : quad) {
+                put16(bsp, static_cast<int16_t>(v));
+                put16(bsp, 0);
+                putf(bsp, 0);
+                putf(bsp, 0);
+            }
+        }
+    put32(bsp, POF_BSP_EOF);
+    put32(bsp, 0);
+
+    out.insert(out.end(), {'P', 'S', 'P', 'O'});
+    put32(out, 2117);
+    std::vector<uint8_t> hdr;
+    putf(hdr, 100);
+    put32(hdr, 0);
+    put32(hdr, 1);
+    putv(hdr, -100, -100, -100);
+    putv(hdr, 100, 100, 100);
+    put32(hdr, 1);
+    put32(hdr, 0);
+    chunk("HDR2", hdr);
+    std::vector<uint8_t> obj;
+    put32(obj, 0);
+    putf(obj, 100);
+    put32(obj, -1);
+    putv(obj, 0, 0, 0);
+    putv(obj, 0, 0, 0);
+    putv(obj, -100, -100, -100);
+    putv(obj, 100, 100, 100);
+    put32(obj, 6);
+    obj.insert(obj.end(), {'d', 'e', 't', 'a', 'i', 'l'});
+    put32(obj, 0);
+    put32(obj, -1);
+    put32(obj, -1);
+    put32(obj, 0);
+    put32(obj, static_cast<int32_t>(bsp.size()));
+    obj.insert(obj.end(), bsp.begin(), bsp.end());
+    chunk("OBJ2", obj);
+    return out;
+}
+
+// A DDS with a full mip chain of random blocks in the given FourCC format.
+static std::vector<uint8_t> make_synthetic_dds(int size, const char* fourcc, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(128, 0);
+    auto put = [&](size_t offset, uint32_t v) { std::memcpy(&data[offset], &v, 4); };
+    int mips = 1;
+    while ((size >> mips) > 0) ++mips;
+    std::memcpy(data.data(), "DDS ", 4);
+    put(4, 124); put(12, size); put(16, size); put(28, mips);
+    put(76, 32); put(80, 0x4);
+    std::memcpy(&data[84], fourcc, 4);
+    size_t block_bytes = std::strcmp(fourcc, "DXT1") == 0 ? 8 : 16;
+    for (int level = 0; level < mips; ++level) {
+        size_t blocks = size_t((std::max(1, size >> level) + 3) / 4);
+        for (size_t i = 0; i < blocks * blocks * block_bytes; ++i)
+            data.push_back(static_cast<uint8_t>(rng()));
+    }
+    return data;
+}
+
+// A bottom-up 24- or 32-bit TGA, uncompressed or RLE. Pixels repeat in
+// short runs, as in game art with flat areas, so RLE gets both run and raw
+// packets.
+static std::vector<uint8_t> make_synthetic_tga(int width, int height, int bits, bool rle, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(18, 0);
+    data[2] = rle ? 10 : 2;
+    data[12] = width & 0xFF; data[13] = width >> 8;
+    data[14] = height & 0xFF; data[15] = height >> 8;
+    data[16] = static_cast<uint8_t>(bits);
+    data[17] = bits == 32 ? 8 : 0;
+    const int bpp = bits / 8;
+    std::vector<uint8_t> pixels;
+    const size_t count = size_t(width) * height;
+    while (pixels.size() < count * bpp) {
+        uint8_t px[4] = {uint8_t(rng()), uint8_t(rng()), uint8_t(rng()), uint8_t(rng())};
+        size_t repeat = rng() % 4 == 0 ? 1 + rng() % 40 : 1;
+        for (size_t r = 0; r < repeat && pixels.size() < count * bpp; ++r)
+            pixels.insert(pixels.end(), px, px + bpp);
+    }
+    if (!rle) {
+        data.insert(data.end(), pixels.begin(), pixels.end());
+        return data;
+    }
+    auto same = [&](size_t a, size_t b) { return std::memcmp(&pixels[a * bpp], &pixels[b * bpp], bpp) == 0; };
+    for (size_t i = 0; i < count;) {
+        size_t j = i + 1;
+        while (j < count && j - i < 128 && same(i, j)) ++j;
+        if (j - i >= 2) {
+            data.push_back(static_cast<uint8_t>(0x80 | (j - i - 1)));
+            data.insert(data.end(), &pixels[i * bpp], &pixels[i * bpp] + bpp);
+        } else {
+            while (j < count && j - i < 128 && (j + 1 == count || !same(j, j + 1))) ++j;
+            data.push_back(static_cast<uint8_t>(j - i - 1));
+            data.insert(data.end(), &pixels[i * bpp], &pixels[j * bpp]);
+        }
+        i = j;
+    }
+    return data;
+}
+
+// A ships.tbl-like table of about `size` bytes: sections, `$Name:` blocks,
+// fields, comments, strings and numbers. With `latin1`, some names carry
+// Windows-1252 accents, so the text has to be converted.
+static std::string make_synthetic_table(size_t size, bool latin1, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string text = "; Synthetic table\n#Ship Classes\n\n";
+    for (int ship = 0; text.size() < size; ++ship) {
+        if (ship % 200 == 199) text += "#End\n\n#Ship Classes ; continued\n\n";
+        text += "$Name:                 GTF Ship " + std::to_string(ship) + (latin1 && ship % 7 == 0 ? "\xE9" : "") + "\n";
+        text += "$Short name:           S" + std::to_string(ship) + "\n";
+        text += "$Species:              Terran\n";
+        text += "+Tech Description:\nXSTR(\"A fighter; fast and light\", " + std::to_string(rng() % 5000) + ")\n";
+        text += "$end_multi_text\n";
+        text += "$Density:              1\n";
+        text += "$Max Velocity:         " + std::to_string(rng() % 100) + ".0, " + std::to_string(rng() % 100) +
+                ".0, " + std::to_string(rng() % 100) + ".0\n";
+        text += "$Rotation time:        " + std::to_string(rng() % 5) + ".5, 2.5, 3.0 // seconds\n";
+        text += "/* Afterburner\n   settings */\n$Afterburner:          YES\n";
+        text += "\t+Aburner Max Vel:    0.0, 0.0, " + std::to_string(rng() % 200) + ".0\n";
+        text += "$Flags:                ( \"player_ship\" \"default_player_ship\" )\n\n";
+    }
+    text += "#End\n";
+    return text;
+}
+
+static void print_json(const BenchConfig& config, const std::vector<BenchResult>& results) {
+    std::printf("{\n  \"config\": {\"entries\": %d, \"max_size\": %d, \"pcx\": \"%dx%d\", \"reads\": %d},\n",
+                config.entries, config.max_size, config.pcx_width, config.pcx_height, config.reads);
+    std::printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        std::printf("    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, \"mb_per_s\": %.2f, "
+                    "\"ops_per_s\": %.1f, \"peak_rss_kb\": %ld}%s\n",
+                    r.name.c_str(), r.iterations, r.ns_per_op, r.mb_per_s, r.ops_per_s, r.peak_rss_kb,
+                    i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+}
+
+static int usage() {
+    std::fprintf(stderr, "usage: vp_bench [--entries N] [--max-size BYTES] [--pcx WxH] [--reads N] "
+                         "[--min-seconds S] [--seed N]\n");
+    return 2;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return usage();
+        const char* value = argv[++i];
+        if (arg == "--entries") config.entries = std::atoi(value);
+        else if (arg == "--max-size") config.max_size = std::atoi(value);
+        else if (arg == "--reads") config.reads = std::atoi(value);
+        else if (arg == "--min-seconds") config.min_seconds = std::atof(value);
+        else if (arg == "--seed") config.seed = static_cast<unsigned>(std::atoi(value));
+        else if (arg == "--pcx") {
+            if (std::sscanf(value, "%dx%d", &config.pcx_width, &config.pcx_height) != 2) return usage();
+        } else return usage();
+    }
+    if (config.entries <= 0 || config.max_size <= 0 || config.pcx_width <= 0 || config.pcx_height <= 0)
+        return usage();
+
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("vp_bench." + std::to_string(getpid()));
+    fs::create_directories(dir);
+    std::string archive = (dir / "synthetic.vp").string();
+    write_synthetic_vp(archive, config);
+
+    std::vector<BenchResult> results;
+
+    results.push_back(run_bench("vp_load", config, [&]() {
+        VPParser parser;
+        parser.load(archive, false);
+        return std::make_pair(uint64_t(parser.entries.size()) * 44, uint64_t(1));
+    }));
+
+    // What every instrumented call pays while tracing is off.
+    results.push_back(run_bench("trace_scope_disabled", config, [&]() {
+        const int n = 1000000;
+        for (int i = 0; i < n; ++i) {
+            VPTraceScope trace("bench");
+            trace.set_bytes(i);
+        }
+        return std::make_pair(uint64_t(0), uint64_t(n));
+    }));
+
+    for (bool mapped : {true, false}) {
+        VPParser parser;
+        parser.load(archive, mapped);
+        std::vector<size_t> files;
+        for (size_t i = 0; i < parser.entries.size(); ++i)
+            if (!parser.entries[i].is_dir) files.push_back(i);
+        std::mt19937 rng(config.seed);
+        std::vector<uint8_t> scratch;
+        results.push_back(run_bench(mapped ? "vp_random_read_mmap" : "vp_random_read_pread", config, [&]() {
+            uint64_t bytes = 0, checksum = 0;
+            for (int i = 0; i < config.reads; ++i) {
+                VPView data = parser.read(parser.entries[files[rng() % files.size()]], scratch);
+                for (size_t k = 0; k < data.size; k += 64) // touch every cache line
+                    checksum += data.data[k];
+                bytes += data.size;
+            }
+            if (checksum == 1) std::fputc(' ', stderr);
+            return std::make_pair(bytes, uint64_t(config.reads));
+        }));
+    }
+
+    {
+        VPParser parser;
+        parser.load(archive);
+        std::string out_dir = (dir / "extract").string();
+        results.push_back(run_bench("vp_extract_all", config, [&]() {
+            VPExtractProgress progress;
+            VPExtractResult r = vp_extract(parser, {}, out_dir, progress);
+            return std::make_pair(r.bytes, uint64_t(r.files));
+        }));
+        fs::remove_all(out_dir);
+        results.push_back(run_bench("vp_verify_all", config, [&]() {
+            VPVerifyProgress progress;
+            VPVerifyResult r = vp_verify(parser, progress);
+            return std::make_pair(r.bytes, uint64_t(r.files));
+        }));
+        std::string repacked = (dir / "repacked.vp").string();
+        results.push_back(run_bench("vp_repack", config, [&]() {
+            VPWriter writer;
+            writer.add_archive(parser);
+            VPWriteResult r = writer.write(repacked);
+            return std::make_pair(r.bytes_in, uint64_t(r.files));
+        }));
+        // Every entry has a match of the same size and timestamp, so this
+        // measures the content comparison alone.
+        VPParser copy;
+        copy.load(repacked, false);
+        results.push_back(run_bench("vp_diff_contents", config, [&]() {
+            VPDiffOptions options;
+            options.compare_all = true;
+            VPDiffResult r = vp_diff(parser, copy, options);
+            return std::make_pair(r.bytes_compared * 2, uint64_t(r.entries.size()));
+        }));
+    }
+
+    {
+        std::vector<uint8_t> pcx = make_synthetic_pcx(config.pcx_width, config.pcx_height, config.seed);
+        uint64_t pixels = uint64_t(config.pcx_width) * config.pcx_height;
+        results.push_back(run_bench("pcx_load_from_memory", config, [&]() {
+            PCXImage image = load_pcx_from_memory(pcx.data(), pcx.size());
+            return std::make_pair(uint64_t(image.rgba_data.size()), uint64_t(1));
+        }));
+        std::vector<uint8_t> rgba(pixels * 4);
+        results.push_back(run_bench("pcx_decode_into", config, [&]() {
+            decode_pcx_into(pcx.data(), pcx.size(), rgba.data(), size_t(config.pcx_width) * 4);
+            return std::make_pair(uint64_t(rgba.size()), uint64_t(1));
+        }));
+        results.push_back(run_bench("thumbnail_box_filter", config, [&]() {
+            Thumbnail thumb = make_thumbnail(rgba.data(), config.pcx_width, config.pcx_height,
+                                             size_t(config.pcx_width) * 4, 4, 128);
+            return std::make_pair(uint64_t(rgba.size()), uint64_t(thumb.width > 0));
+        }));
+    }
+
+    for (int bits : {24, 32}) {
+        for (bool rle : {false, true}) {
+            std::vector<uint8_t> tga = make_synthetic_tga(config.pcx_width, config.pcx_height, bits, rle, config.seed);
+            std::vector<uint8_t> rgba(size_t(config.pcx_width) * config.pcx_height * 4);
+            std::string name = "tga_" + std::to_string(bits) + (rle ? "_rle" : "_raw");
+            results.push_back(run_bench(name + "_decode_into", config, [&]() {
+                decode_tga_into(tga.data(), tga.size(), rgba.data(), size_t(config.pcx_width) * 4);
+                return std::make_pair(uint64_t(rgba.size()), uint64_t(1));
+            }));
+#ifdef VP_BENCH_PIXBUF
+            // What the viewer did before it had a TGA decoder of its own.
+            results.push_back(run_bench(name + "_pixbuf_loader", config, [&]() {
+                GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+                gdk_pixbuf_loader_write(loader, tga.data(), tga.size(), nullptr);
+                gdk_pixbuf_loader_close(loader, nullptr);
+                GdkPixbuf* pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+                uint64_t bytes = pixbuf ? uint64_t(gdk_pixbuf_get_rowstride(pixbuf)) * gdk_pixbuf_get_height(pixbuf) : 0;
+                g_object_unref(loader);
+                return std::make_pair(bytes, uint64_t(1));
+            }));
+#endif
+        }
+    }
+
+    for (bool latin1 : {false, true}) {
+        std::string table = make_synthetic_table(size_t(4) << 20, latin1, config.seed);
+        std::string utf8;
+        results.push_back(run_bench(latin1 ? "text_to_utf8_convert" : "text_to_utf8_valid", config, [&]() {
+            text_to_utf8(reinterpret_cast<const uint8_t*>(table.data()), table.size(), utf8);
+            return std::make_pair(uint64_t(table.size()), uint64_t(1));
+        }));
+        if (!latin1) {
+            results.push_back(run_bench("text_scan", config, [&]() {
+                TextScan scan = text_scan(utf8);
+                return std::make_pair(uint64_t(utf8.size()), uint64_t(scan.lines));
+            }));
+        }
+    }
+
+    {
+        std::vector<uint8_t> ani = make_synthetic_ani(config.pcx_width, config.pcx_height, 60, config.seed);
+        ANIMovie movie;
+        movie.load(ani.data(), ani.size());
+        results.push_back(run_bench("ani_decode_frames", config, [&]() {
+            for (int f = 0; f < movie.frame_count(); ++f)
+                movie.decode_ahead(f);
+            return std::make_pair(uint64_t(movie.frame_bytes()) * movie.frame_count(),
+                                  uint64_t(movie.frame_count()));
+        }));
+    }
+
+    for (const char* fourcc : {"DXT1", "DXT5"}) {
+        std::vector<uint8_t> dds = make_synthetic_dds(2048, fourcc, config.seed);
+        DDSInfo info = dds_parse(dds.data(), dds.size());
+        std::vector<uint8_t> rgba(size_t(2048) * 2048 * 4);
+        std::string name = std::string("dds_") + (fourcc[3] == '1' ? "bc1" : "bc3");
+        results.push_back(run_bench(name + "_2048_full", config, [&]() {
+            decode_dds_into(info, dds.data(), dds.size(), 0, rgba.data(), 2048 * 4);
+            return std::make_pair(uint64_t(rgba.size()), uint64_t(1));
+        }));
+        // What a preview of pcx_width x pcx_height actually decodes.
+        int level = dds_pick_level(info, config.pcx_width, config.pcx_height);
+        results.push_back(run_bench(name + "_2048_preview", config, [&]() {
+            decode_dds_into(info, dds.data(), dds.size(), level, rgba.data(),
+                            size_t(dds_level_width(info, level)) * 4);
+            uint64_t bytes = uint64_t(dds_level_width(info, level)) * dds_level_height(info, level) * 4;
+            return std::make_pair(bytes, uint64_t(1));
+        }));
+    }
+
+    {
+        std::vector<uint8_t> pof = make_synthetic_pof(100, 100); // 20,000 triangles
+        results.push_back(run_bench("pof_load_mesh", config, [&]() {
+            POFModel model;
+            model.load(pof.data(), pof.size());
+            return std::make_pair(uint64_t(pof.size()), uint64_t(model.triangles().size() > 0));
+        }));
+        POFModel model;
+        model.load(pof.data(), pof.size());
+        POFRenderer renderer;
+        renderer.set_triangles(model.triangles());
+        std::vector<uint32_t> frame(size_t(config.pcx_width) * config.pcx_height);
+        POFCamera camera;
+        for (auto mode : {POFRenderMode::Flat, POFRenderMode::Wireframe}) {
+            results.push_back(run_bench(mode == POFRenderMode::Flat ? "pof_render_flat" : "pof_render_wireframe",
+                                        config, [&]() {
+                camera.yaw += 0.05f;
+                renderer.render(frame.data(), config.pcx_width, config.pcx_height, size_t(config.pcx_width) * 4,
+                                camera, mode);
+                return std::make_pair(uint64_t(frame.size()) * 4, uint64_t(1));
+            }));
+        }
+    }
+
+    fs::remove_all(dir);
+    print_json(config, results);
+    return 0;
+}
@@ -0,0 +1,388 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fnmatch.h>
+#include <strings.h>
+#include "vp_diff.h"
+#include "vp_extract.h"
+#include "vp_parser.h"
+#include "vp_search.h"
+#include "vp_verify.h"
+#include "vp_vfs.h"
+#include "vp_writer.h"
+
+// Headless subcommands. These only use VPParser and friends so scripts can
+// run them without a display and without paying for GTK/GStreamer startup.
+
+inline bool vp_cli_is_command(const char* arg) {
+    static const char* const commands[] = {"list", "info", "extract", "cat", "which", "grep", "verify", "pack", "repack", "diff"};
+    for (const char* c : commands)
+        if (std::strcmp(arg, c) == 0) return true;
+    return false;
+}
+
+inline int vp_cli_usage() {
+    std::fprintf(stderr,
+        "usage: vpview list [-l] <archive.vp>\n"
+        "       vpview info <archive.vp>\n"
+        "       vpview extract <archive.vp> <glob> [-o <dir>]\n"
+        "       vpview cat <archive.vp> <path>\n"
+        "       vpview which <path> <archive.vp>...\n"
+        "       vpview grep [-i] [-E] <pattern> <archive.vp>...\n"
+        "       vpview verify [--export <manifest>] [--manifest <manifest>] <archive.vp>...\n"
+        "       vpview pack [--no-dedupe] <dir> <out.vp>\n"
+        "       vpview repack [--no-dedupe] <archive.vp> <out.vp>\n"
+        "       vpview diff [-c] [--delta <out.vp>] <old.vp> <new.vp>\n"
+        "Any command (or the viewer) takes --trace <trace.json> to record a performance trace.\n");
+    return 2;
+}
+
+inline bool vp_cli_load(VPParser& parser, const char* path, bool use_mmap) {
+    if (parser.load(path, use_mmap)) return true;
+    std::fprintf(stderr, "vpview: cannot read VP archive '%s'\n", path);
+    return false;
+}
+
+inline int vp_cli_list(int argc, char* argv[]) {
+    bool long_format = false;
+    const char* archive = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-l") == 0) long_format = true;
+        else if (!archive) archive = argv[i];
+        else return vp_cli_usage();
+    }
+    if (!archive) return vp_cli_usage();
+
+    VPParser parser;
+    if (!vp_cli_load(parser, archive, false)) return 1;
+
+    // One buffered write per few thousand lines rather than one per entry.
+    static char outbuf[1 << 16];
+    std::setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    for (const auto& entry : parser.entries) {
+        if (entry.is_dir) continue;
+        if (long_format)
+            std::printf("%10d %10d %s\n", entry.size, entry.timestamp, entry.full_path.data());
+        else
+            std::printf("%s\n", entry.full_path.data());
+    }
+    return std::fflush(stdout) == 0 ? 0 : 1;
+}
+
+inline int vp_cli_info(int argc, char* argv[]) {
+    if (argc != 3) return vp_cli_usage();
+    VPParser parser;
+    if (!vp_cli_load(parser, argv[2], false)) return 1;
+
+    size_t files = 0, dirs = 0, out_of_bounds = 0;
+    uint64_t payload = 0;
+    for (const auto& entry : parser.entries) {
+        if (entry.is_dir) {
+            ++dirs;
+            continue;
+        }
+        ++files;
+        payload += static_cast<uint64_t>(entry.size);
+        if (!parser.in_bounds(entry)) ++out_of_bounds;
+    }
+    std::printf("archive:      %s\n", parser.filename.c_str());
+    std::printf("file size:    %zu\n", parser.file_size());
+    std::printf("files:        %zu\n", files);
+    std::printf("directories:  %zu\n", dirs);
+    std::printf("payload:      %llu\n", static_cast<unsigned long long>(payload));
+    if (out_of_bounds > 0)
+        std::printf("out of bounds: %zu\n", out_of_bounds);
+    return out_of_bounds > 0 ? 1 : 0;
+}
+
+inline int vp_cli_extract(int argc, char* argv[]) {
+    const char* archive = nullptr;
+    const char* pattern = nullptr;
+    std::string out_dir = ".";
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) out_dir = argv[++i];
+        else if (!archive) archive = argv[i];
+        else if (!pattern) pattern = argv[i];
+        else return vp_cli_usage();
+    }
+    if (!archive || !pattern) return vp_cli_usage();
+
+    VPParser parser;
+    if (!vp_cli_load(parser, archive, true)) return 1;
+
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < parser.entries.size(); ++i) {
+        const auto& entry = parser.entries[i];
+        if (!entry.is_dir && fnmatch(pattern, entry.full_path.data(), FNM_CASEFOLD) == 0)
+            indices.push_back(i);
+    }
+    if (indices.empty()) {
+        std::fprintf(stderr, "vpview: no entries match '%s'\n", pattern);
+        return 1;
+    }
+
+    VPExtractProgress progress;
+    VPExtractResult r = vp_extract(parser, indices, out_dir, progress);
+    std::fprintf(stderr, "extracted %zu files (%.1f MB) in %.3f s, %.1f MB/s, %.0f files/s\n",
+                 r.files, r.bytes / (1024.0 * 1024.0), r.seconds, r.mb_per_sec(), r.files_per_sec());
+    if (r.failed > 0) {
+        std::fprintf(stderr, "vpview: %zu files failed\n", r.failed);
+        return 1;
+    }
+    return 0;
+}
+
+inline int vp_cli_cat(int argc, char* argv[]) {
+    if (argc != 4) return vp_cli_usage();
+    VPParser parser;
+    if (!vp_cli_load(parser, argv[2], true)) return 1;
+
+    for (const auto& entry : parser.entries) {
+        if (entry.is_dir || strcasecmp(entry.full_path.data(), argv[3]) != 0) continue;
+        std::vector<uint8_t> scratch;
+        VPView data = parser.read(entry, scratch);
+        if (data.empty() && entry.size > 0) {
+            std::fprintf(stderr, "vpview: '%s' lies outside the archive\n", argv[3]);
+            return 1;
+        }
+        return std::fwrite(data.data, 1, data.size, stdout) == data.size && std::fflush(stdout) == 0 ? 0 : 1;
+    }
+    std::fprintf(stderr, "vpview: no entry '%s'\n", argv[3]);
+    return 1;
+}
+
+// Mounts the archives in load order (later ones override earlier ones) and
+// reports which one provides `path`.
+inline int vp_cli_which(int argc, char* argv[]) {
+    if (argc < 4) return vp_cli_usage();
+    VPVFS vfs;
+    for (int i = 3; i < argc; ++i) {
+        if (!vfs.mount(argv[i], false)) {
+            std::fprintf(stderr, "vpview: cannot read VP archive '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    const VPVFSNode* node = vfs.find(argv[2]);
+    if (!node) {
+        std::fprintf(stderr, "vpview: no entry '%s'\n", argv[2]);
+        return 1;
+    }
+    std::printf("%s\n", vfs.archive(*node).filename.c_str());
+    for (size_t i = 0; i + 1 < node->sources.size(); ++i)
+        std::printf("  overrides %s\n", vfs.archive(node->sources[i]).filename.c_str());
+    return 0;
+}
+
+// Searches the merged contents of the archives (mounted as for `which`)
+// and prints path:line:text for every matching line. Exits like grep:
+// 0 with matches, 1 without, 2 on errors.
+inline int vp_cli_grep(int argc, char* argv[]) {
+    VPSearchOptions options;
+    std::vector<const char*> archives;
+    const char* pattern = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-i") == 0) options.ignore_case = true;
+        else if (std::strcmp(argv[i], "-E") == 0) options.regex = true;
+        else if (!pattern) pattern = argv[i];
+        else archives.push_back(argv[i]);
+    }
+    if (!pattern || archives.empty()) return vp_cli_usage();
+    options.pattern = pattern;
+
+    VPVFS vfs;
+    for (const char* archive : archives) {
+        if (!vfs.mount(archive)) {
+            std::fprintf(stderr, "vpview: cannot read VP archive '%s'\n", archive);
+            return 2;
+        }
+    }
+
+    static char outbuf[1 << 16];
+    std::setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    std::mutex out_mutex;
+    VPSearchProgress progress;
+    VPSearchResult r = vp_search(vfs, options, progress, [&](std::vector<VPSearchHit>&& hits) {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        for (const auto& hit : hits) {
+            const auto& node = vfs.nodes()[hit.node];
+            std::printf("%.*s:%u:%s\n", static_cast<int>(node.full_path.size()), node.full_path.data(),
+                        hit.line, hit.snippet.c_str());
+        }
+    });
+    std::fflush(stdout);
+    if (!r.error.empty()) {
+        std::fprintf(stderr, "vpview: %s\n", r.error.c_str());
+        return 2;
+    }
+    std::fprintf(stderr, "searched %zu files (%.1f MB) in %.3f s, %.1f MB/s, %zu hits in %zu files\n",
+                 r.files, r.bytes / (1024.0 * 1024.0), r.seconds, r.mb_per_sec(), r.hits, r.files_matched);
+    return r.hits > 0 ? 0 : 1;
+}
+
+// Checks entry bounds and overlaps and hashes every entry; with --manifest
+// the hashes are compared against an earlier --export. Prints one line per
+// problem and exits 0 when there are none, 1 when there are, 2 on errors.
+inline int vp_cli_verify(int argc, char* argv[]) {
+    const char* export_path = nullptr;
+    const char* manifest_path = nullptr;
+    std::vector<const char*> archives;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--export") == 0 && i + 1 < argc) export_path = argv[++i];
+        else if (std::strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) manifest_path = argv[++i];
+        else archives.push_back(argv[i]);
+    }
+    if (archives.empty()) return vp_cli_usage();
+
+    VPManifest manifest;
+    if (manifest_path) {
+        std::ifstream in(manifest_path);
+        std::string error;
+        if (!in) error = "cannot read manifest";
+        if (!in || !vp_manifest_read(in, manifest, error)) {
+            std::fprintf(stderr, "vpview: %s: %s\n", manifest_path, error.c_str());
+            return 2;
+        }
+    }
+
+    std::vector<VPVerifyResult> results;
+    size_t issues = 0;
+    for (const char* archive : archives) {
+        VPParser parser;
+        if (!vp_cli_load(parser, archive, false)) return 2;
+        VPVerifyProgress progress;
+        VPVerifyResult r = vp_verify(parser, progress);
+        if (manifest_path)
+            vp_verify_compare(r, manifest);
+        for (const auto& issue : r.issues) {
+            if (issue.path.empty()) std::printf("%s: %s\n", archive, issue.message.c_str());
+            else std::printf("%s: %s: %s\n", archive, issue.path.c_str(), issue.message.c_str());
+        }
+        std::fprintf(stderr, "%s: verified %zu files (%.1f MB) in %.3f s, %.1f MB/s, %zu problems\n", archive,
+                     r.files, r.bytes / (1024.0 * 1024.0), r.seconds, r.mb_per_sec(), r.issues.size());
+        issues += r.issues.size();
+        results.push_back(std::move(r));
+    }
+
+    if (export_path) {
+        std::ofstream out(export_path);
+        vp_manifest_write(out, results);
+        if (!out) {
+            std::fprintf(stderr, "vpview: cannot write manifest '%s'\n", export_path);
+            return 2;
+        }
+    }
+    return issues > 0 ? 1 : 0;
+}
+
+// pack: builds an archive from the contents of a directory. repack:
+// rewrites an archive (the output may be the input), storing identical
+// payloads once unless --no-dedupe is given.
+inline int vp_cli_pack(int argc, char* argv[], bool repack) {
+    VPWriteOptions options;
+    const char* in = nullptr;
+    const char* out = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--no-dedupe") == 0) options.dedupe = false;
+        else if (!in) in = argv[i];
+        else if (!out) out = argv[i];
+        else return vp_cli_usage();
+    }
+    if (!in || !out) return vp_cli_usage();
+
+    VPWriter writer;
+    VPParser parser;
+    if (repack) {
+        if (!vp_cli_load(parser, in, false)) return 1;
+        writer.add_archive(parser);
+    } else {
+        std::string error;
+        if (!writer.add_tree(in, error)) {
+            std::fprintf(stderr, "vpview: %s\n", error.c_str());
+            return 1;
+        }
+        for (const auto& link : writer.skipped_links())
+            std::fprintf(stderr, "vpview: skipped symbolic link %s\n", link.c_str());
+    }
+
+    VPWriteResult r = writer.write(out, options);
+    if (!r.ok()) {
+        std::fprintf(stderr, "vpview: %s\n", r.error.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, "packed %zu files (%.1f MB) into %s (%.1f MB) in %.3f s, %.1f MB/s",
+                 r.files, r.bytes_in / (1024.0 * 1024.0), out, r.file_size / (1024.0 * 1024.0), r.seconds,
+                 r.mb_per_sec());
+    if (options.dedupe)
+        std::fprintf(stderr, ", %zu duplicates (%.1f MB saved)", r.deduped, r.bytes_saved / (1024.0 * 1024.0));
+    std::fprintf(stderr, "\n");
+    if (r.skipped > 0)
+        std::fprintf(stderr, "vpview: skipped %zu empty files\n", r.skipped);
+    return 0;
+}
+
+// Prints "A", "D" or "M" and the path for every added, removed or changed
+// file; -c also reads files whose size and timestamp match. --delta writes
+// the added and changed files to a new archive. Exits like diff: 0 when
+// the archives hold the same files, 1 when they differ, 2 on errors.
+inline int vp_cli_diff(int argc, char* argv[]) {
+    VPDiffOptions options;
+    const char* delta = nullptr;
+    const char* archives[2] = {nullptr, nullptr};
+    int count = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-c") == 0) options.compare_all = true;
+        else if (std::strcmp(argv[i], "--delta") == 0 && i + 1 < argc) delta = argv[++i];
+        else if (count < 2) archives[count++] = argv[i];
+        else return vp_cli_usage();
+    }
+    if (count != 2) return vp_cli_usage();
+
+    VPParser old_vp, new_vp;
+    if (!vp_cli_load(old_vp, archives[0], false) || !vp_cli_load(new_vp, archives[1], false)) return 2;
+    VPDiffResult r = vp_diff(old_vp, new_vp, options);
+
+    static char outbuf[1 << 16];
+    std::setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    for (const auto& d : r.entries) {
+        if (d.status == VPDiffStatus::Unchanged) continue;
+        char tag = d.status == VPDiffStatus::Added ? 'A' : d.status == VPDiffStatus::Removed ? 'D' : 'M';
+        std::string_view path = d.new_index >= 0 ? new_vp.entries[d.new_index].full_path
+                                                 : old_vp.entries[d.old_index].full_path;
+        std::printf("%c %.*s\n", tag, static_cast<int>(path.size()), path.data());
+    }
+    std::fflush(stdout);
+    std::fprintf(stderr, "%zu added, %zu removed, %zu changed, %zu unchanged; compared %zu files (%.1f MB) in %.3f s\n",
+                 r.added, r.removed, r.changed, r.unchanged, r.compared, r.bytes_compared / (1024.0 * 1024.0),
+                 r.seconds);
+
+    if (delta) {
+        VPWriteResult w = vp_write_delta(new_vp, r, delta);
+        if (!w.ok()) {
+            std::fprintf(stderr, "vpview: %s\n", w.error.c_str());
+            return 2;
+        }
+        std::fprintf(stderr, "wrote %zu files (%.1f MB) to %s\n", w.files, w.file_size / (1024.0 * 1024.0), delta);
+        if (r.removed > 0)
+            std::fprintf(stderr, "vpview: the delta cannot express the %zu removed files\n", r.removed);
+    }
+    return r.identical() ? 0 : 1;
+}
+
+inline int vp_cli_main(int argc, char* argv[]) {
+    std::string command = argv[1];
+    if (command == "list") return vp_cli_list(argc, argv);
+    if (command == "info") return vp_cli_info(argc, argv);
+    if (command == "extract") return vp_cli_extract(argc, argv);
+    if (command == "cat") return vp_cli_cat(argc, argv);
+    if (command == "which") return vp_cli_which(argc, argv);
+    if (command == "grep") return vp_cli_grep(argc, argv);
+    if (command == "verify") return vp_cli_verify(argc, argv);
+    if (command == "pack") return vp_cli_pack(argc, argv, false);
+    if (command == "repack") return vp_cli_pack(argc, argv, true);
+    if (command == "diff") return vp_cli_diff(argc, argv);
+    return vp_cli_usage();
+}
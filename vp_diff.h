@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "vp_parser.h"
+#include "vp_writer.h"
+
+enum class VPDiffStatus { Added, Removed, Changed, Unchanged };
+
+struct VPDiffEntry {
+    VPDiffStatus status = VPDiffStatus::Unchanged;
+    int32_t old_index = -1; // into the old archive's entries, -1 if added
+    int32_t new_index = -1; // into the new archive's entries, -1 if removed
+    bool compared = false;  // decided by reading the contents
+};
+
+struct VPDiffOptions {
+    bool compare_all = false; // also read entries whose size and timestamp match
+    unsigned threads = 0;
+};
+
+struct VPDiffResult {
+    std::vector<VPDiffEntry> entries; // sorted by path
+    size_t added = 0;
+    size_t removed = 0;
+    size_t changed = 0;
+    size_t unchanged = 0;
+    size_t compared = 0;
+    uint64_t bytes_compared = 0; // read from each side
+    double seconds = 0.0;
+
+    bool identical() const { return added == 0 && removed == 0 && changed == 0; }
+};
+
+// Compares two entries' bytes a chunk at a time, stopping at the first
+// difference. Unreadable entries compare unequal.
+inline bool vp_same_contents(const VPParser& pa, const VPEntry& a, const VPParser& pb, const VPEntry& b,
+                             std::vector<uint8_t>& buf_a, std::vector<uint8_t>& buf_b, uint64_t& bytes) {
+    if (a.size != b.size || !pa.in_bounds(a) || !pb.in_bounds(b)) return false;
+    const size_t chunk = 1u << 20;
+    buf_a.resize(chunk);
+    buf_b.resize(chunk);
+    auto read_all = [](int fd, uint8_t* dst, size_t n, uint64_t offset) {
+        for (size_t done = 0; done < n;) {
+            ssize_t got = pread(fd, dst + done, n - done, static_cast<off_t>(offset + done));
+            if (got <= 0) return false;
+            done += static_cast<size_t>(got);
+        }
+        return true;
+    };
+    for (uint64_t at = 0; at < static_cast<uint64_t>(a.size); at += chunk) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(chunk, static_cast<uint64_t>(a.size) - at));
+        if (!read_all(pa.fd(), buf_a.data(), n, static_cast<uint64_t>(a.offset) + at) ||
+            !read_all(pb.fd(), buf_b.data(), n, static_cast<uint64_t>(b.offset) + at))
+            return false;
+        bytes += n;
+        if (std::memcmp(buf_a.data(), buf_b.data(), n) != 0) return false;
+    }
+    return true;
+}
+
+// Matches the files of two archives by full path (case-insensitively, as
+// the game does) and classifies each. A size difference decides "changed"
+// and equal size and timestamp decide "unchanged" without reading
+// anything; only the rest have their contents compared, in parallel and a
+// megabyte at a time. Both directories are sorted as index arrays and
+// merged, so memory stays proportional to the entry count, not the
+// archive size.
+inline VPDiffResult vp_diff(const VPParser& old_vp, const VPParser& new_vp, const VPDiffOptions& options = {}) {
+    auto start = std::chrono::steady_clock::now();
+    VPDiffResult result;
+
+    auto path_less = [](const VPParser& p) {
+        return [&p](int32_t a, int32_t b) {
+            std::string_view pa = p.entries[a].full_path, pb = p.entries[b].full_path;
+            int c = strncasecmp(pa.data(), pb.data(), std::min(pa.size(), pb.size()));
+            return c != 0 ? c < 0 : pa.size() < pb.size();
+        };
+    };
+    auto sorted_files = [&](const VPParser& p) {
+        std::vector<int32_t> files;
+        for (size_t i = 0; i < p.entries.size(); ++i)
+            if (!p.entries[i].is_dir) files.push_back(static_cast<int32_t>(i));
+        std::stable_sort(files.begin(), files.end(), path_less(p));
+        // A path listed twice: the later record wins, as when mounting.
+        auto less = path_less(p);
+        std::vector<int32_t> unique;
+        for (size_t k = 0; k < files.size(); ++k)
+            if (k + 1 == files.size() || less(files[k], files[k + 1]))
+                unique.push_back(files[k]);
+        return unique;
+    };
+    const std::vector<int32_t> a = sorted_files(old_vp), b = sorted_files(new_vp);
+
+    std::vector<size_t> undecided; // into result.entries
+    for (size_t i = 0, j = 0; i < a.size() || j < b.size();) {
+        VPDiffEntry d;
+        int c;
+        if (i == a.size()) c = 1;
+        else if (j == b.size()) c = -1;
+        else {
+            std::string_view pa = old_vp.entries[a[i]].full_path, pb = new_vp.entries[b[j]].full_path;
+            c = strncasecmp(pa.data(), pb.data(), std::min(pa.size(), pb.size()));
+            if (c == 0) c = pa.size() < pb.size() ? -1 : pa.size() > pb.size() ? 1 : 0;
+        }
+        if (c < 0) {
+            d.status = VPDiffStatus::Removed;
+            d.old_index = a[i++];
+        } else if (c > 0) {
+            d.status = VPDiffStatus::Added;
+            d.new_index = b[j++];
+        } else {
+            d.old_index = a[i++];
+            d.new_index = b[j++];
+            VPEntry ea = old_vp.entries[d.old_index], eb = new_vp.entries[d.new_index];
+            if (ea.size != eb.size) {
+                d.status = VPDiffStatus::Changed;
+            } else if (ea.timestamp == eb.timestamp && !options.compare_all) {
+                d.status = VPDiffStatus::Unchanged;
+            } else {
+                d.compared = true;
+                undecided.push_back(result.entries.size());
+            }
+        }
+        result.entries.push_back(d);
+    }
+
+    // Read the new archive front to back; the old one follows along as
+    // far as its layout allows.
+    std::sort(undecided.begin(), undecided.end(), [&](size_t x, size_t y) {
+        return new_vp.entries.offsets[result.entries[x].new_index] < new_vp.entries.offsets[result.entries[y].new_index];
+    });
+    unsigned threads = options.threads;
+    if (threads == 0)
+        threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, undecided.size())));
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> bytes{0};
+    const size_t batch = 16;
+    auto worker = [&]() {
+        std::vector<uint8_t> buf_a, buf_b;
+        uint64_t read = 0;
+        for (;;) {
+            size_t first = next.fetch_add(batch);
+            if (first >= undecided.size()) break;
+            for (size_t k = first; k < std::min(first + batch, undecided.size()); ++k) {
+                VPDiffEntry& d = result.entries[undecided[k]];
+                bool same = vp_same_contents(old_vp, old_vp.entries[d.old_index], new_vp, new_vp.entries[d.new_index],
+                                             buf_a, buf_b, read);
+                d.status = same ? VPDiffStatus::Unchanged : VPDiffStatus::Changed;
+            }
+        }
+        bytes += read;
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    for (const auto& d : result.entries) {
+        switch (d.status) {
+        case VPDiffStatus::Added: ++result.added; break;
+        case VPDiffStatus::Removed: ++result.removed; break;
+        case VPDiffStatus::Changed: ++result.changed; break;
+        case VPDiffStatus::Unchanged: ++result.unchanged; break;
+        }
+    }
+    result.compared = undecided.size();
+    result.bytes_compared = bytes;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Writes a VP holding only the added and changed files of `new_vp`, under
+// their full paths. Mounted over the old archive it gives the new contents
+// (removals aside: a VP can only add or override files).
+inline VPWriteResult vp_write_delta(const VPParser& new_vp, const VPDiffResult& diff, const std::string& path,
+                                   const VPWriteOptions& options = {}) {
+    // The diff is sorted by path, so each directory's files are contiguous;
+    // open and close directories as the path prefix changes.
+    VPWriter writer;
+    std::vector<std::string_view> open_dirs;
+    for (const auto& d : diff.entries) {
+        if (d.status != VPDiffStatus::Added && d.status != VPDiffStatus::Changed) continue;
+        VPEntry entry = new_vp.entries[d.new_index];
+        std::vector<std::string_view> dirs;
+        std::string_view rest = entry.full_path;
+        for (size_t slash; (slash = rest.find('/')) != std::string_view::npos; rest.remove_prefix(slash + 1))
+            dirs.push_back(rest.substr(0, slash));
+        size_t keep = 0;
+        while (keep < open_dirs.size() && keep < dirs.size() && open_dirs[keep].size() == dirs[keep].size() &&
+               strncasecmp(open_dirs[keep].data(), dirs[keep].data(), dirs[keep].size()) == 0)
+            ++keep;
+        for (; open_dirs.size() > keep; open_dirs.pop_back())
+            writer.end_dir();
+        for (; open_dirs.size() < dirs.size(); open_dirs.push_back(dirs[open_dirs.size()]))
+            writer.begin_dir(std::string(dirs[open_dirs.size()]));
+        writer.add_file(std::string(entry.name), {"", &new_vp, entry.offset, entry.size, entry.timestamp});
+    }
+    return writer.write(path, options);
+}
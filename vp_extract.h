@@ -0,0 +1,232 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include "vp_parser.h"
+#include "vp_trace.h"
+
+// Shared between the extraction workers and whoever is watching them. Each
+// vp_extract() call adds its work to the totals before its workers start, so
+// one progress object can span several archives; the counters only grow.
+struct VPExtractProgress {
+    std::atomic<size_t> files_total{0};
+    std::atomic<uint64_t> bytes_total{0};
+    std::atomic<size_t> files_done{0};
+    std::atomic<uint64_t> bytes_done{0};
+    std::atomic<bool> cancel{false};
+};
+
+struct VPExtractResult {
+    size_t files = 0;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    bool cancelled = false;
+
+    double mb_per_sec() const { return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+    double files_per_sec() const { return seconds > 0 ? files / seconds : 0.0; }
+};
+
+// Copies `size` bytes at `offset` of the archive into `out_fd`, in the kernel
+// where possible. Falls back to writing from a view of the entry.
+inline bool vp_copy_entry(const VPParser& parser, const VPEntry& entry, int out_fd,
+                          std::vector<uint8_t>& scratch, VPExtractProgress& progress) {
+    size_t remaining = static_cast<size_t>(entry.size);
+#if defined(__linux__)
+    off_t in_off = entry.offset;
+    while (remaining > 0) {
+        ssize_t n = copy_file_range(parser.fd(), &in_off, out_fd, nullptr, remaining, 0);
+        if (n <= 0) break;
+        remaining -= static_cast<size_t>(n);
+        progress.bytes_done += static_cast<uint64_t>(n);
+    }
+    while (remaining > 0) {
+        ssize_t n = sendfile(out_fd, parser.fd(), &in_off, remaining);
+        if (n <= 0) break;
+        remaining -= static_cast<size_t>(n);
+        progress.bytes_done += static_cast<uint64_t>(n);
+    }
+    if (remaining == 0) return true;
+#endif
+    VPView data = parser.read(entry, scratch);
+    if (data.empty()) return false;
+    const uint8_t* p = data.end() - remaining;
+    while (remaining > 0) {
+        ssize_t n = write(out_fd, p, remaining);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        remaining -= static_cast<size_t>(n);
+        progress.bytes_done += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// Resolves an archive path below `base`. Names come straight from the
+// archive, so reject anything that could land outside it: absolute paths,
+// empty, `.` or `..` components (either separator), and as a backstop any
+// result whose normalised form no longer lies under the normalised base.
+inline bool vp_extract_path(const std::filesystem::path& base, std::string_view name,
+                            std::filesystem::path& out) {
+    if (name.empty()) return false;
+    std::filesystem::path rel;
+    size_t start = 0;
+    for (;;) {
+        size_t end = name.find_first_of("/\\", start);
+        std::string_view part = name.substr(start, end == std::string_view::npos ? end : end - start);
+        if (part.empty() || part == "." || part == ".." || part.find(':') != std::string_view::npos)
+            return false;
+        rel /= std::string(part);
+        if (end == std::string_view::npos) break;
+        start = end + 1;
+    }
+    if (rel.is_absolute() || rel.has_root_path()) return false;
+
+    std::error_code ec;
+    std::filesystem::path root = std::filesystem::absolute(base.empty() ? "." : base, ec).lexically_normal();
+    if (ec) return false;
+    std::filesystem::path full = (root / rel).lexically_normal();
+    auto r = root.begin();
+    auto f = full.begin();
+    for (; r != root.end() && !r->empty(); ++r, ++f) {
+        if (f == full.end() || *f != *r) return false;
+    }
+    out = (base / rel).lexically_normal();
+    return true;
+}
+
+// Extracts the given entries (every file when `indices` is empty) below
+// `base_path`. Entries are handed out in archive offset order in small
+// batches so the source is read close to sequentially while `threads`
+// workers overlap the file creation and write costs. Entries whose names
+// would escape `base_path` count as failed; when several entries map to the
+// same output file only the last one in the directory is written, the way
+// a later entry shadows an earlier one in game. Blocks until done or until
+// progress.cancel is set.
+inline VPExtractResult vp_extract(const VPParser& parser, std::vector<size_t> indices,
+                                  const std::string& base_path, VPExtractProgress& progress,
+                                  unsigned threads = 0) {
+    auto start = std::chrono::steady_clock::now();
+    VPTraceScope trace("vp_extract");
+    VPExtractResult result;
+
+    if (indices.empty()) {
+        for (size_t i = 0; i < parser.entries.size(); ++i)
+            indices.push_back(i);
+    }
+    indices.erase(std::remove_if(indices.begin(), indices.end(), [&](size_t i) {
+        return parser.entries.sizes[i] <= 0;
+    }), indices.end());
+
+    // Resolve every output path up front, dropping unsafe names and all but
+    // the last entry for each path so no two workers open the same file.
+    const std::filesystem::path base(base_path);
+    size_t rejected = 0;
+    std::unordered_map<std::string, size_t> by_path;
+    std::sort(indices.begin(), indices.end());
+    for (size_t i : indices) {
+        std::filesystem::path out;
+        if (!vp_extract_path(base, parser.entries[i].full_path, out)) {
+            ++rejected;
+            continue;
+        }
+        by_path[out.string()] = i;
+    }
+    std::vector<std::string> out_paths(parser.entries.size());
+    indices.clear();
+    for (auto& [path, i] : by_path) {
+        out_paths[i] = path;
+        indices.push_back(i);
+    }
+
+    const auto& offsets = parser.entries.offsets;
+    std::sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
+        return offsets[a] < offsets[b];
+    });
+
+    progress.files_total += indices.size() + rejected;
+    progress.files_done += rejected;
+    std::set<std::filesystem::path> dirs;
+    for (size_t i : indices) {
+        progress.bytes_total += static_cast<uint64_t>(parser.entries.sizes[i]);
+        dirs.insert(std::filesystem::path(out_paths[i]).parent_path());
+    }
+    for (const auto& dir : dirs) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+    }
+
+#if defined(__linux__)
+    posix_fadvise(parser.fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (threads == 0)
+        threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, indices.size())));
+
+    const size_t batch = 16;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> failed{rejected};
+    std::atomic<uint64_t> bytes{0};
+    auto worker = [&]() {
+        std::vector<uint8_t> scratch;
+        for (;;) {
+            size_t first = next.fetch_add(batch);
+            if (first >= indices.size()) return;
+            size_t last = std::min(first + batch, indices.size());
+            VPTraceScope batch_trace("extract batch");
+            int64_t batch_bytes = 0;
+            for (size_t k = first; k < last; ++k) {
+                if (progress.cancel) return;
+                const auto& entry = parser.entries[indices[k]];
+                const std::string& out_path = out_paths[indices[k]];
+                int out_fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                bool ok = out_fd >= 0 && parser.in_bounds(entry) &&
+                          vp_copy_entry(parser, entry, out_fd, scratch, progress);
+                if (out_fd >= 0)
+                    ::close(out_fd);
+                if (ok) {
+                    ++done;
+                    bytes += static_cast<uint64_t>(entry.size);
+                    batch_bytes += entry.size;
+                } else {
+                    ++failed;
+                }
+                ++progress.files_done;
+            }
+            batch_trace.set_bytes(batch_bytes);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back([&]() {
+            vp_trace_name_thread("extract worker");
+            worker();
+        });
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    result.files = done;
+    result.failed = failed;
+    result.bytes = bytes;
+    result.cancelled = progress.cancel;
+    trace.set_bytes(static_cast<int64_t>(result.bytes));
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
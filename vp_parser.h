@@ -0,0 +1,292 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vp_trace.h"
+
+// One directory entry, materialised on demand from VPEntryTable. Cheap to
+// copy; `name` and `full_path` point into the table's string arena and stay
+// valid until the parser is reloaded. Both are NUL-terminated, so `.data()`
+// can be handed to C APIs.
+struct VPEntry {
+    int offset;
+    int size;
+    std::string_view name;
+    int timestamp;
+    bool is_dir = false;
+    std::string_view full_path;
+};
+
+// Struct-of-arrays directory table. Every full path is interned once in
+// `arena` (NUL-terminated); an entry's name is the tail of its path.
+class VPEntryTable {
+public:
+    class iterator {
+    public:
+        iterator(const VPEntryTable* table, size_t i) : m_table(table), m_i(i) {}
+        VPEntry operator*() const { return (*m_table)[m_i]; }
+        iterator& operator++() { ++m_i; return *this; }
+        bool operator!=(const iterator& o) const { return m_i != o.m_i; }
+        bool operator==(const iterator& o) const { return m_i == o.m_i; }
+    private:
+        const VPEntryTable* m_table;
+        size_t m_i;
+    };
+
+    size_t size() const { return offsets.size(); }
+    bool empty() const { return offsets.empty(); }
+    iterator begin() const { return {this, 0}; }
+    iterator end() const { return {this, size()}; }
+
+    VPEntry operator[](size_t i) const {
+        VPEntry e;
+        e.offset = offsets[i];
+        e.size = sizes[i];
+        e.timestamp = timestamps[i];
+        e.is_dir = sizes[i] == 0;
+        const char* path = arena.data() + path_offsets[i];
+        e.full_path = std::string_view(path, path_lengths[i]);
+        e.name = std::string_view(arena.data() + name_offsets[i], path + path_lengths[i] - (arena.data() + name_offsets[i]));
+        return e;
+    }
+
+    void clear() {
+        offsets.clear();
+        sizes.clear();
+        timestamps.clear();
+        path_offsets.clear();
+        path_lengths.clear();
+        name_offsets.clear();
+        parents.clear();
+        arena.clear();
+    }
+
+    void reserve(size_t n) {
+        offsets.reserve(n);
+        sizes.reserve(n);
+        timestamps.reserve(n);
+        path_offsets.reserve(n);
+        path_lengths.reserve(n);
+        name_offsets.reserve(n);
+        parents.reserve(n);
+    }
+
+    size_t memory_usage() const {
+        return (offsets.capacity() + sizes.capacity() + timestamps.capacity() + parents.capacity()) * sizeof(int32_t) +
+               (path_offsets.capacity() + path_lengths.capacity() + name_offsets.capacity()) * sizeof(uint32_t) +
+               arena.capacity();
+    }
+
+    std::vector<int32_t> offsets;
+    std::vector<int32_t> sizes;
+    std::vector<int32_t> timestamps;
+    std::vector<uint32_t> path_offsets; // into arena
+    std::vector<uint32_t> path_lengths;
+    std::vector<uint32_t> name_offsets; // into arena, inside the entry's path
+    std::vector<int32_t> parents;       // index of the enclosing directory, -1 at the root
+    std::string arena;
+};
+
+// Read-only view of a run of archive bytes, std::span<const uint8_t> style.
+struct VPView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+    const char* chars() const { return reinterpret_cast<const char*>(data); }
+    bool empty() const { return size == 0; }
+};
+
+// Read-only mapping of a whole archive. Held through a shared_ptr so anything
+// still pointing into it (e.g. queued audio buffers) keeps it alive.
+class VPMapping {
+public:
+    VPMapping(int fd, size_t size) : m_size(size) {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            m_data = static_cast<const uint8_t*>(p);
+    }
+    ~VPMapping() {
+        if (m_data)
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    VPMapping(const VPMapping&) = delete;
+    VPMapping& operator=(const VPMapping&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+class VPParser {
+public:
+    VPParser() = default;
+    ~VPParser() { close(); }
+    VPParser(const VPParser&) = delete;
+    VPParser& operator=(const VPParser&) = delete;
+
+    // Parses the directory of `filename`. With `use_mmap` the whole archive is
+    // mapped so entry views point straight into the page cache; if mapping
+    // fails, entries are read on demand with pread instead.
+    bool load(const std::string& filename, bool use_mmap = true) {
+        VPTraceScope trace("VPParser::load");
+        trace.set_detail(filename);
+        close();
+        entries.clear();
+        this->filename = filename;
+
+        m_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) return false;
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            close();
+            return false;
+        }
+        m_file_size = static_cast<size_t>(st.st_size);
+
+        uint8_t header[16];
+        if (!pread_all(header, sizeof(header), 0) || std::memcmp(header, "VPVP", 4) != 0) {
+            close();
+            return false;
+        }
+
+        int32_t version, diroffset, direntries;
+        std::memcpy(&version, header + 4, 4);
+        std::memcpy(&diroffset, header + 8, 4);
+        std::memcpy(&direntries, header + 12, 4);
+
+        const size_t record = 44; // offset, size, name[32], timestamp
+        if (diroffset < 0 || direntries < 0 ||
+            static_cast<size_t>(diroffset) + static_cast<size_t>(direntries) * record > m_file_size) {
+            close();
+            return false;
+        }
+
+        // The whole directory in one read, parsed from memory.
+        std::vector<uint8_t> dir(static_cast<size_t>(direntries) * record);
+        trace.set_bytes(static_cast<int64_t>(dir.size()));
+        if (!pread_all(dir.data(), dir.size(), diroffset)) {
+            close();
+            return false;
+        }
+
+        entries.reserve(direntries);
+        entries.arena.reserve(static_cast<size_t>(direntries) * 24);
+
+        // Open directories as entry indices; the root has none.
+        std::vector<int32_t> dir_stack;
+
+        for (int32_t i = 0; i < direntries; ++i) {
+            const uint8_t* r = dir.data() + static_cast<size_t>(i) * record;
+            int32_t offset, size, timestamp;
+            std::memcpy(&offset, r, 4);
+            std::memcpy(&size, r + 4, 4);
+            std::memcpy(&timestamp, r + 40, 4);
+            const char* name = reinterpret_cast<const char*>(r + 8);
+            size_t name_len = strnlen(name, 32);
+
+            if (name_len == 2 && name[0] == '.' && name[1] == '.') {
+                if (!dir_stack.empty()) dir_stack.pop_back();
+                continue;
+            }
+
+            int32_t parent = dir_stack.empty() ? -1 : dir_stack.back();
+            uint32_t path_offset = static_cast<uint32_t>(entries.arena.size());
+            if (parent >= 0) {
+                // Copy the parent's path from the arena; append() may
+                // reallocate, so go through an offset rather than a pointer.
+                entries.arena.append(entries.arena, entries.path_offsets[parent], entries.path_lengths[parent]);
+                entries.arena.push_back('/');
+            }
+            uint32_t name_offset = static_cast<uint32_t>(entries.arena.size());
+            entries.arena.append(name, name_len);
+            uint32_t path_length = static_cast<uint32_t>(entries.arena.size()) - path_offset;
+            entries.arena.push_back('\0');
+
+            if (size == 0)
+                dir_stack.push_back(static_cast<int32_t>(entries.size()));
+
+            entries.offsets.push_back(offset);
+            entries.sizes.push_back(size);
+            entries.timestamps.push_back(timestamp);
+            entries.path_offsets.push_back(path_offset);
+            entries.path_lengths.push_back(path_length);
+            entries.name_offsets.push_back(name_offset);
+            entries.parents.push_back(parent);
+        }
+
+        if (use_mmap && m_file_size > 0) {
+            auto map = std::make_shared<VPMapping>(m_fd, m_file_size);
+            if (map->data()) {
+                madvise(const_cast<uint8_t*>(map->data()), m_file_size, MADV_RANDOM);
+                m_map = std::move(map);
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        m_map.reset();
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd = -1;
+        m_file_size = 0;
+    }
+
+    bool is_mapped() const { return m_map != nullptr; }
+    int fd() const { return m_fd; }
+    size_t file_size() const { return m_file_size; }
+    const std::shared_ptr<const VPMapping>& mapping() const { return m_map; }
+
+    bool in_bounds(const VPEntry& entry) const {
+        return entry.offset >= 0 && entry.size >= 0 &&
+               static_cast<size_t>(entry.offset) + static_cast<size_t>(entry.size) <= m_file_size;
+    }
+
+    // Zero-copy view of an entry inside the mapping. Empty if the archive is
+    // not mapped or the entry does not fit inside the file.
+    VPView view(const VPEntry& entry) const {
+        if (!m_map || !in_bounds(entry)) return {};
+        return {m_map->data() + entry.offset, static_cast<size_t>(entry.size)};
+    }
+
+    // View of an entry's bytes: straight from the mapping when there is one,
+    // otherwise read into `scratch`. Empty on out-of-bounds entries or I/O
+    // errors. Safe to call from several threads with distinct scratch buffers.
+    VPView read(const VPEntry& entry, std::vector<uint8_t>& scratch) const {
+        if (m_map) return view(entry);
+        if (m_fd < 0 || !in_bounds(entry)) return {};
+        scratch.resize(entry.size);
+        if (!pread_all(scratch.data(), scratch.size(), entry.offset)) return {};
+        return {scratch.data(), scratch.size()};
+    }
+
+    std::string filename;
+    VPEntryTable entries;
+
+private:
+    bool pread_all(uint8_t* dst, size_t size, size_t offset) const {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(m_fd, dst + done, size - done, offset + done);
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    int m_fd = -1;
+    size_t m_file_size = 0;
+    std::shared_ptr<const VPMapping> m_map;
+};
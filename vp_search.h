@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <regex.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include "vp_parser.h"
+#include "vp_trace.h"
+#include "vp_vfs.h"
+
+// Literal substring search. Candidates are found a block at a time by
+// comparing every position against the needle's first and last bytes (both
+// at once, so common first letters rarely survive) and only those are
+// verified with a full compare. With ignore_case, letters are folded by
+// setting bit 0x20, which lets a few non-letters through as candidates;
+// verification rejects them.
+class VPMatcher {
+public:
+    VPMatcher(std::string needle, bool ignore_case) : m_needle(std::move(needle)), m_ignore_case(ignore_case) {
+        if (m_ignore_case)
+            for (auto& c : m_needle) c = fold(c);
+    }
+
+    const std::string& needle() const { return m_needle; }
+
+    // First match at or after `from`, or npos.
+    size_t find(const char* data, size_t size, size_t from = 0) const {
+        const size_t n = m_needle.size();
+        if (n == 0) return from <= size ? from : npos;
+        if (from > size || size - from < n) return npos;
+#if defined(__x86_64__) && defined(__GNUC__)
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2)
+            return find_avx2(data, size, from);
+        return find_sse2(data, size, from);
+#else
+        return find_scalar(data, size, from);
+#endif
+    }
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+    static char fold(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+    // Byte mask applied before comparing: 0x20 folds case for letters.
+    char case_bit(char c) const { return m_ignore_case && ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ? 0x20 : 0; }
+
+    bool verify(const char* p) const {
+        if (!m_ignore_case)
+            return std::memcmp(p, m_needle.data(), m_needle.size()) == 0;
+        for (size_t i = 0; i < m_needle.size(); ++i)
+            if (fold(p[i]) != m_needle[i]) return false;
+        return true;
+    }
+
+    size_t find_scalar(const char* data, size_t size, size_t from) const {
+        const size_t last = size - m_needle.size();
+        for (size_t i = from; i <= last; ++i)
+            if (verify(data + i)) return i;
+        return npos;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    size_t find_sse2(const char* data, size_t size, size_t from) const {
+        const size_t n = m_needle.size();
+        const char f = m_needle.front(), l = m_needle.back();
+        const __m128i first = _mm_set1_epi8(f), last = _mm_set1_epi8(l);
+        const __m128i fbit = _mm_set1_epi8(case_bit(f)), lbit = _mm_set1_epi8(case_bit(l));
+        size_t i = from;
+        for (; i + n - 1 + 16 <= size; i += 16) {
+            __m128i a = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), fbit);
+            __m128i b = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + n - 1)), lbit);
+            unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+            while (mask) {
+                unsigned bit = __builtin_ctz(mask);
+                if (verify(data + i + bit)) return i + bit;
+                mask &= mask - 1;
+            }
+        }
+        return i + n <= size ? find_scalar(data, size, i) : npos;
+    }
+
+    __attribute__((target("avx2")))
+    size_t find_avx2(const char* data, size_t size, size_t from) const {
+        const size_t n = m_needle.size();
+        const char f = m_needle.front(), l = m_needle.back();
+        const __m256i first = _mm256_set1_epi8(f), last = _mm256_set1_epi8(l);
+        const __m256i fbit = _mm256_set1_epi8(case_bit(f)), lbit = _mm256_set1_epi8(case_bit(l));
+        size_t i = from;
+        for (; i + n - 1 + 32 <= size; i += 32) {
+            __m256i a = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), fbit);
+            __m256i b = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + n - 1)), lbit);
+            unsigned mask = static_cast<unsigned>(
+                _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+            while (mask) {
+                unsigned bit = __builtin_ctz(mask);
+                if (verify(data + i + bit)) return i + bit;
+                mask &= mask - 1;
+            }
+        }
+        return i + n <= size ? find_sse2(data, size, i) : npos;
+    }
+#endif
+
+    std::string m_needle;
+    bool m_ignore_case;
+};
+
+struct VPSearchOptions {
+    std::string pattern;
+    bool ignore_case = false;
+    bool regex = false;         // POSIX extended regex; never matches across lines
+    bool skip_binary = true;    // entries with a NUL in their first 4 KiB
+    size_t max_snippet = 160;
+    unsigned threads = 0;
+};
+
+struct VPSearchHit {
+    VPVFSRef ref;
+    uint32_t node = 0; // VPVFS node of the entry
+    uint32_t line = 0; // 1-based
+    std::string snippet;
+};
+
+// Same shape as VPExtractProgress: counters only grow, cancel stops workers.
+struct VPSearchProgress {
+    std::atomic<size_t> files_total{0};
+    std::atomic<uint64_t> bytes_total{0};
+    std::atomic<size_t> files_done{0};
+    std::atomic<uint64_t> bytes_done{0};
+    std::atomic<size_t> hits{0};
+    std::atomic<bool> cancel{false};
+};
+
+struct VPSearchResult {
+    size_t files = 0;
+    size_t files_matched = 0;
+    size_t hits = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    bool cancelled = false;
+    std::string error; // e.g. an invalid regex
+
+    double mb_per_sec() const { return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+};
+
+// Called from the worker threads with all hits of one entry, in line order.
+using VPSearchSink = std::function<void(std::vector<VPSearchHit>&&)>;
+
+// Searches the winning entry of every file in `vfs` straight out of the
+// archives. Entries are handed out in (archive, offset) order in small
+// batches, as in vp_extract(), so each archive is read close to
+// sequentially. A line is reported once however often it matches.
+inline VPSearchResult vp_search(const VPVFS& vfs, const VPSearchOptions& options, VPSearchProgress& progress,
+                                const VPSearchSink& sink) {
+    auto start = std::chrono::steady_clock::now();
+    VPTraceScope trace("vp_search");
+    trace.set_detail(options.pattern);
+    VPSearchResult result;
+
+    // glibc's regexec locks the regex_t it is given, so each worker
+    // compiles its own; this first one validates the pattern and serves the
+    // calling thread.
+    const int re_flags = REG_EXTENDED | REG_NEWLINE | (options.ignore_case ? REG_ICASE : 0);
+    regex_t re;
+    if (options.regex) {
+        int rc = regcomp(&re, options.pattern.c_str(), re_flags);
+        if (rc != 0) {
+            char message[256];
+            regerror(rc, &re, message, sizeof(message));
+            result.error = message;
+            return result;
+        }
+    }
+    std::unique_ptr<regex_t, void (*)(regex_t*)> re_guard(options.regex ? &re : nullptr, regfree);
+    const VPMatcher matcher(options.pattern, options.ignore_case);
+
+    std::vector<uint32_t> files;
+    const auto& nodes = vfs.nodes();
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].is_dir) continue;
+        VPEntry entry = vfs.entry(nodes[i]);
+        if (entry.size <= 0) continue;
+        files.push_back(i);
+        progress.bytes_total += static_cast<uint64_t>(entry.size);
+    }
+    std::sort(files.begin(), files.end(), [&](uint32_t a, uint32_t b) {
+        const auto& ra = nodes[a].ref;
+        const auto& rb = nodes[b].ref;
+        if (ra.archive != rb.archive) return ra.archive < rb.archive;
+        return vfs.archive(ra.archive).entries.offsets[ra.entry] < vfs.archive(rb.archive).entries.offsets[rb.entry];
+    });
+    progress.files_total += files.size();
+
+    unsigned threads = options.threads;
+    if (threads == 0)
+        threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, files.size())));
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> matched{0};
+    std::atomic<size_t> hits{0};
+    std::atomic<uint64_t> bytes{0};
+    const size_t batch = 16;
+
+    auto worker = [&](regex_t* re) {
+        std::vector<uint8_t> scratch;
+        for (;;) {
+            size_t first = next.fetch_add(batch);
+            if (first >= files.size()) return;
+            size_t last = std::min(first + batch, files.size());
+            for (size_t k = first; k < last; ++k) {
+                if (progress.cancel) return;
+                const VPVFSNode& node = nodes[files[k]];
+                VPEntry entry = vfs.entry(node);
+                VPView view = vfs.archive(node).read(entry, scratch);
+                const char* data = view.chars();
+                const size_t size = view.size;
+                ++done;
+                ++progress.files_done;
+                progress.bytes_done += static_cast<uint64_t>(entry.size);
+                bytes += size;
+                if (size == 0) continue;
+                if (options.skip_binary && std::memchr(data, 0, std::min<size_t>(size, 4096)))
+                    continue;
+
+                std::vector<VPSearchHit> found;
+                size_t line_start = 0;
+                uint32_t line_no = 1;
+                auto report = [&](size_t at) {
+                    // Advance the line count to `at`, then emit that line.
+                    for (const char* p; (p = static_cast<const char*>(std::memchr(data + line_start, '\n', at - line_start)));) {
+                        line_start = static_cast<size_t>(p - data) + 1;
+                        ++line_no;
+                    }
+                    const char* nl = static_cast<const char*>(std::memchr(data + at, '\n', size - at));
+                    size_t line_end = nl ? static_cast<size_t>(nl - data) : size;
+                    size_t end = line_end;
+                    if (end > line_start && data[end - 1] == '\r') --end;
+                    VPSearchHit hit;
+                    hit.ref = node.ref;
+                    hit.node = files[k];
+                    hit.line = line_no;
+                    hit.snippet.assign(data + line_start, std::min(end - line_start, options.max_snippet));
+                    found.push_back(std::move(hit));
+                    return line_end; // resume after this line
+                };
+
+                if (options.regex) {
+                    // REG_STARTEND bounds the scan by [rm_so, rm_eo) instead of
+                    // a terminator, so the archive bytes are searched in place
+                    // and NULs are ordinary characters, as for the literal
+                    // matcher. With REG_NEWLINE one call scans the whole rest
+                    // of the entry rather than one line; offsets come back
+                    // relative to `data`.
+                    size_t pos = 0;
+                    regmatch_t match;
+                    for (;;) {
+                        match.rm_so = static_cast<regoff_t>(pos);
+                        match.rm_eo = static_cast<regoff_t>(size);
+                        if (pos >= size || regexec(re, data, 1, &match, REG_STARTEND) != 0) break;
+                        pos = report(static_cast<size_t>(match.rm_so)) + 1;
+                    }
+                } else {
+                    size_t pos = 0;
+                    while ((pos = matcher.find(data, size, pos)) != VPMatcher::npos) {
+                        pos = report(pos) + 1;
+                        if (pos > size) break;
+                    }
+                }
+
+                if (!found.empty()) {
+                    ++matched;
+                    hits += found.size();
+                    progress.hits += found.size();
+                    sink(std::move(found));
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back([&]() {
+            regex_t own;
+            if (!options.regex) {
+                worker(nullptr);
+            } else if (regcomp(&own, options.pattern.c_str(), re_flags) == 0) {
+                worker(&own);
+                regfree(&own);
+            }
+        });
+    worker(options.regex ? &re : nullptr);
+    for (auto& t : pool)
+        t.join();
+
+    result.files = done;
+    result.files_matched = matched;
+    result.hits = hits;
+    result.bytes = bytes;
+    result.cancelled = progress.cancel;
+    trace.set_bytes(static_cast<int64_t>(result.bytes));
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
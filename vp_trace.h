@@ -0,0 +1,249 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Scoped-timer tracing written out in the Chrome trace-event format, which
+// chrome://tracing and ui.perfetto.dev open directly. Every thread that
+// records an event gets its own track.
+//
+// Off by default; a disabled VPTraceScope costs one relaxed load and a
+// branch, and reads no clock. Turn it on with `--trace <file>` or
+// VPVIEW_TRACE=<file> (vp_trace_init()), and write the file once every
+// traced thread has finished (vp_trace_finish()).
+inline std::atomic<bool> g_vp_trace_enabled{false};
+
+struct VPTraceEvent {
+    const char* name;   // a string literal
+    std::string detail; // shown as args.detail if not empty
+    int64_t bytes;      // shown as args.bytes if not negative
+    double start_us;
+    double duration_us;
+};
+
+class VPTrace {
+public:
+    static VPTrace& instance() {
+        static VPTrace trace;
+        return trace;
+    }
+
+    void start(std::string path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = std::move(path);
+        m_origin = std::chrono::steady_clock::now();
+        g_vp_trace_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    const std::string& path() const { return m_path; }
+
+    double now_us() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_origin).count();
+    }
+
+    void record(VPTraceEvent&& event) {
+        ThreadBuffer& buffer = local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.push_back(std::move(event));
+    }
+
+    // Names the calling thread's track.
+    void name_thread(std::string name) {
+        ThreadBuffer& buffer = local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.name = std::move(name);
+    }
+
+    // Stops recording and writes every thread's events. Threads still
+    // running may record until they notice; what they add after their
+    // buffer was written is dropped.
+    bool write(std::string& error) {
+        g_vp_trace_enabled.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        FILE* out = std::fopen(m_path.c_str(), "w");
+        if (!out) {
+            error = "cannot write " + m_path + ": " + std::strerror(errno);
+            return false;
+        }
+        std::string line;
+        bool first = true;
+        auto emit = [&]() {
+            std::fputs(first ? "\n" : ",\n", out);
+            std::fwrite(line.data(), 1, line.size(), out);
+            first = false;
+        };
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+        for (const auto& buffer : m_threads) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            const std::string tid = std::to_string(buffer->tid);
+            line = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":";
+            append_string(line, buffer->name.empty() ? "thread " + tid : buffer->name);
+            line += "}}";
+            emit();
+            line = "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid +
+                   ",\"args\":{\"sort_index\":" + tid + "}}";
+            emit();
+            for (const auto& event : buffer->events) {
+                char times[96];
+                std::snprintf(times, sizeof(times), ",\"ts\":%.3f,\"dur\":%.3f", event.start_us, event.duration_us);
+                line = "{\"name\":";
+                append_string(line, event.name);
+                line += ",\"cat\":\"vpview\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + times;
+                if (event.bytes >= 0 || !event.detail.empty()) {
+                    line += ",\"args\":{";
+                    if (event.bytes >= 0)
+                        line += "\"bytes\":" + std::to_string(event.bytes);
+                    if (!event.detail.empty()) {
+                        line += event.bytes >= 0 ? ",\"detail\":" : "\"detail\":";
+                        append_string(line, event.detail);
+                    }
+                    line += "}";
+                }
+                line += "}";
+                emit();
+            }
+            buffer->events.clear();
+        }
+        std::fputs("\n]}\n", out);
+        if (std::fclose(out) != 0) {
+            error = "cannot write " + m_path + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct ThreadBuffer {
+        std::mutex mutex; // taken by its own thread and by write(), so never contended while tracing
+        uint32_t tid = 0;
+        std::string name;
+        std::vector<VPTraceEvent> events;
+    };
+
+    // Buffers are owned here rather than by the thread, so events survive
+    // the short-lived worker pools that record them.
+    ThreadBuffer& local() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            auto owned = std::make_unique<ThreadBuffer>();
+            buffer = owned.get();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer->tid = static_cast<uint32_t>(m_threads.size() + 1);
+            m_threads.push_back(std::move(owned));
+        }
+        return *buffer;
+    }
+
+    static void append_string(std::string& out, std::string_view s) {
+        out += '"';
+        for (char c : s) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (u < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", u);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+    std::mutex m_mutex;
+    std::string m_path;
+    std::chrono::steady_clock::time_point m_origin = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<ThreadBuffer>> m_threads;
+};
+
+// Times the enclosing scope as one event on the calling thread's track.
+//
+//     VPTraceScope trace("VPParser::load");
+//     trace.set_bytes(size);
+class VPTraceScope {
+public:
+    explicit VPTraceScope(const char* name) : m_name(name) {
+        if (g_vp_trace_enabled.load(std::memory_order_relaxed)) {
+            m_on = true;
+            m_start = VPTrace::instance().now_us();
+        }
+    }
+    ~VPTraceScope() {
+        if (m_on) {
+            VPTrace& trace = VPTrace::instance();
+            trace.record({m_name, std::move(m_detail), m_bytes, m_start, trace.now_us() - m_start});
+        }
+    }
+    VPTraceScope(const VPTraceScope&) = delete;
+    VPTraceScope& operator=(const VPTraceScope&) = delete;
+
+    bool enabled() const { return m_on; }
+    void set_bytes(int64_t bytes) { m_bytes = bytes; }
+    void set_detail(std::string_view detail) {
+        if (m_on) m_detail.assign(detail.data(), detail.size());
+    }
+
+private:
+    const char* m_name;
+    std::string m_detail;
+    int64_t m_bytes = -1;
+    double m_start = 0.0;
+    bool m_on = false;
+};
+
+inline void vp_trace_name_thread(const char* name) {
+    if (g_vp_trace_enabled.load(std::memory_order_relaxed))
+        VPTrace::instance().name_thread(name);
+}
+
+// Turns tracing on if argv has `--trace <file>` (removed from argv, so the
+// rest of the command line parses as usual) or VPVIEW_TRACE names a file.
+// The calling thread's track is named "main".
+inline void vp_trace_init(int& argc, char** argv) {
+    std::string path;
+    if (const char* env = std::getenv("VPVIEW_TRACE"); env && *env)
+        path = env;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--") == 0) break;
+        std::string_view arg = argv[i];
+        int used = 0;
+        if (arg == "--trace" && i + 1 < argc) {
+            path = argv[i + 1];
+            used = 2;
+        } else if (arg.substr(0, 8) == "--trace=") {
+            path = std::string(arg.substr(8));
+            used = 1;
+        }
+        if (used) {
+            for (int k = i; k + used <= argc; ++k)
+                argv[k] = argv[k + used];
+            argc -= used;
+            break;
+        }
+    }
+    if (path.empty()) return;
+    VPTrace::instance().start(path);
+    vp_trace_name_thread("main");
+}
+
+// Writes the trace file if tracing is on, reporting the outcome on stderr.
+inline void vp_trace_finish() {
+    if (!g_vp_trace_enabled.load(std::memory_order_relaxed)) return;
+    VPTrace& trace = VPTrace::instance();
+    std::string error;
+    if (trace.write(error))
+        std::fprintf(stderr, "vpview: trace written to %s\n", trace.path().c_str());
+    else
+        std::fprintf(stderr, "vpview: %s\n", error.c_str());
+}
@@ -0,0 +1,443 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+#include "vp_parser.h"
+#include "vp_trace.h"
+
+// CRC-32C (Castagnoli), the polynomial x86 computes in hardware with the
+// SSE4.2 crc32 instruction. Elsewhere a slicing-by-8 table does 8 bytes
+// per step. `crc` is the running value: start at 0, feed the bytes in
+// order.
+inline uint32_t crc32c_table(uint32_t crc, const uint8_t* p, size_t n) {
+    struct Tables {
+        uint32_t t[8][256];
+        Tables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; ++i)
+                for (int s = 1; s < 8; ++s)
+                    t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+    };
+    static const Tables tables;
+    const auto& t = tables.t;
+    crc = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; --n, ++p)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t n) {
+    uint64_t c = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; n > 0; --n, ++p)
+        c32 = _mm_crc32_u8(c32, *p);
+    return ~c32;
+}
+#endif
+
+inline uint32_t crc32c(uint32_t crc, const uint8_t* p, size_t n) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    if (has_sse42)
+        return crc32c_sse42(crc, p, n);
+#endif
+    return crc32c_table(crc, p, n);
+}
+
+// XXH64 (seed 0), fed incrementally so an entry can arrive in pieces.
+class XXH64 {
+public:
+    void update(const uint8_t* p, size_t n) {
+        m_total += n;
+        if (m_buffered + n < 32) {
+            std::memcpy(m_buf + m_buffered, p, n);
+            m_buffered += n;
+            return;
+        }
+        if (m_buffered > 0) {
+            size_t fill = 32 - m_buffered;
+            std::memcpy(m_buf + m_buffered, p, fill);
+            stripe(m_buf);
+            p += fill;
+            n -= fill;
+            m_buffered = 0;
+        }
+        for (; n >= 32; n -= 32, p += 32)
+            stripe(p);
+        std::memcpy(m_buf, p, n);
+        m_buffered = n;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (m_total >= 32) {
+            h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+            for (uint64_t v : m_v)
+                h = (h ^ round(0, v)) * P1 + P4;
+        } else {
+            h = P5;
+        }
+        h += m_total;
+        const uint8_t* p = m_buf;
+        size_t n = m_buffered;
+        for (; n >= 8; n -= 8, p += 8)
+            h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+        if (n >= 4) {
+            h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+            n -= 4;
+        }
+        for (; n > 0; --n, ++p)
+            h = rotl(h ^ (*p * P5), 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 11400714785074694791ull;
+    static constexpr uint64_t P2 = 14029467366897019727ull;
+    static constexpr uint64_t P3 = 1609587929392839161ull;
+    static constexpr uint64_t P4 = 9650029242287828579ull;
+    static constexpr uint64_t P5 = 2870177450012600261ull;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+    static uint64_t read64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+    static uint64_t read32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+    void stripe(const uint8_t* p) {
+        for (int i = 0; i < 4; ++i)
+            m_v[i] = round(m_v[i], read64(p + 8 * i));
+    }
+
+    uint64_t m_v[4] = {P1 + P2, P2, 0, 0ull - P1};
+    uint64_t m_total = 0;
+    uint8_t m_buf[32];
+    size_t m_buffered = 0;
+};
+
+// Same shape as VPExtractProgress: counters only grow, cancel stops workers.
+struct VPVerifyProgress {
+    std::atomic<size_t> files_total{0};
+    std::atomic<uint64_t> bytes_total{0};
+    std::atomic<size_t> files_done{0};
+    std::atomic<uint64_t> bytes_done{0};
+    std::atomic<bool> cancel{false};
+};
+
+struct VPEntryDigest {
+    size_t index = 0; // into parser.entries
+    std::string path;
+    int32_t size = 0;
+    uint32_t crc32c = 0;
+    uint64_t xxh64 = 0;
+    bool hashed = false; // false if the entry could not be read
+};
+
+struct VPVerifyIssue {
+    std::string path; // empty for problems with the archive as a whole
+    std::string message;
+};
+
+struct VPVerifyResult {
+    std::string archive;
+    std::vector<VPEntryDigest> digests; // every file entry, in directory order
+    std::vector<VPVerifyIssue> issues;
+    size_t files = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    bool cancelled = false;
+
+    bool ok() const { return issues.empty() && !cancelled; }
+    double mb_per_sec() const { return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+};
+
+// Checks that every file entry lies inside the archive and that no two
+// overlap, then hashes each entry (CRC-32C and XXH64) straight from the
+// file.
+//
+// The entries are sorted by offset and cut into runs of about 16 MiB; the
+// workers take runs one at a time and read each as one sequential stream
+// of 4 MiB preads, feeding every entry the part of the chunk it covers. So
+// the disk sees a few large sequential readers whatever the entry sizes,
+// and the mapping (which is set up for random access) is never touched.
+inline VPVerifyResult vp_verify(const VPParser& parser, VPVerifyProgress& progress, unsigned threads = 0) {
+    auto start = std::chrono::steady_clock::now();
+    VPTraceScope trace("vp_verify");
+    trace.set_detail(parser.filename);
+    VPVerifyResult result;
+    result.archive = parser.filename;
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < parser.entries.size(); ++i) {
+        VPEntry entry = parser.entries[i];
+        if (entry.is_dir) continue;
+        VPEntryDigest digest;
+        digest.index = i;
+        digest.path = std::string(entry.full_path);
+        digest.size = entry.size;
+        if (!parser.in_bounds(entry)) {
+            char message[96];
+            std::snprintf(message, sizeof(message), "offset %d + size %d is outside the file (%zu bytes)",
+                          entry.offset, entry.size, parser.file_size());
+            result.issues.push_back({digest.path, message});
+        } else {
+            order.push_back(result.digests.size());
+        }
+        result.digests.push_back(std::move(digest));
+    }
+    auto offset_of = [&](size_t d) { return static_cast<uint64_t>(parser.entries.offsets[result.digests[d].index]); };
+    auto end_of = [&](size_t d) { return offset_of(d) + static_cast<uint64_t>(result.digests[d].size); };
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return offset_of(a) < offset_of(b); });
+
+    // Overlaps: each entry against the one reaching furthest before it.
+    // Entries sharing exactly the same bytes are deduplicated payloads (see
+    // VPWriter), not damage.
+    for (size_t k = 1, furthest = order.empty() ? 0 : order[0]; k < order.size(); ++k) {
+        size_t d = order[k];
+        bool shared = offset_of(d) == offset_of(furthest) && end_of(d) == end_of(furthest);
+        if (offset_of(d) < end_of(furthest) && !shared) {
+            char message[64];
+            std::snprintf(message, sizeof(message), "overlaps %.*s",
+                          static_cast<int>(std::min<size_t>(result.digests[furthest].path.size(), 48)),
+                          result.digests[furthest].path.c_str());
+            result.issues.push_back({result.digests[d].path, message});
+        }
+        if (end_of(d) > end_of(furthest)) furthest = d;
+    }
+
+    struct Run {
+        size_t first, last; // into order
+        uint64_t begin, end; // byte range
+    };
+    const uint64_t run_bytes = 16u << 20;
+    std::vector<Run> runs;
+    for (size_t k = 0; k < order.size();) {
+        Run run{k, k, offset_of(order[k]), end_of(order[k])};
+        while (run.last < order.size() && (run.last == k || run.end - run.begin < run_bytes)) {
+            run.end = std::max(run.end, end_of(order[run.last]));
+            ++run.last;
+        }
+        k = run.last;
+        runs.push_back(run);
+        progress.bytes_total += run.end - run.begin;
+    }
+    progress.files_total += order.size();
+
+    if (threads == 0)
+        threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, runs.size())));
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<uint64_t> bytes{0};
+    std::mutex issue_mutex;
+    const size_t chunk_size = 4u << 20;
+
+    auto worker = [&]() {
+        std::vector<uint8_t> chunk(chunk_size);
+        std::vector<XXH64> hashes;
+        std::vector<uint32_t> crcs;
+        for (;;) {
+            size_t r = next.fetch_add(1);
+            if (r >= runs.size() || progress.cancel) return;
+            const Run& run = runs[r];
+            const size_t count = run.last - run.first;
+            hashes.assign(count, XXH64());
+            crcs.assign(count, 0);
+            size_t lo = 0; // entries before this have been fed completely
+            bool read_ok = true;
+
+            for (uint64_t pos = run.begin; pos < run.end && read_ok && !progress.cancel;) {
+                size_t want = static_cast<size_t>(std::min<uint64_t>(chunk_size, run.end - pos));
+                size_t got = 0;
+                while (got < want) {
+                    ssize_t n = pread(parser.fd(), chunk.data() + got, want - got, static_cast<off_t>(pos + got));
+                    if (n <= 0) break;
+                    got += static_cast<size_t>(n);
+                }
+                if (got < want) {
+                    read_ok = false;
+                    break;
+                }
+                const uint64_t chunk_end = pos + want;
+                while (lo < count && end_of(order[run.first + lo]) <= pos) ++lo;
+                for (size_t k = lo; k < count; ++k) {
+                    size_t d = order[run.first + k];
+                    uint64_t b = std::max(offset_of(d), pos), e = std::min(end_of(d), chunk_end);
+                    if (offset_of(d) >= chunk_end) break;
+                    if (b >= e) continue;
+                    const uint8_t* p = chunk.data() + (b - pos);
+                    crcs[k] = crc32c(crcs[k], p, e - b);
+                    hashes[k].update(p, e - b);
+                }
+                pos = chunk_end;
+                bytes += want;
+                progress.bytes_done += want;
+            }
+            if (progress.cancel) return;
+
+            for (size_t k = 0; k < count; ++k) {
+                VPEntryDigest& digest = result.digests[order[run.first + k]];
+                if (read_ok) {
+                    digest.crc32c = crcs[k];
+                    digest.xxh64 = hashes[k].digest();
+                    digest.hashed = true;
+                } else {
+                    std::lock_guard<std::mutex> lock(issue_mutex);
+                    result.issues.push_back({digest.path, "read error"});
+                }
+            }
+            done += count;
+            progress.files_done += count;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    result.files = done;
+    result.bytes = bytes;
+    result.cancelled = progress.cancel;
+    trace.set_bytes(static_cast<int64_t>(result.bytes));
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Manifest: the digests of one or more archives as text, e.g.
+//
+//   # vpview manifest 1
+//   archive root_fs2.vp
+//   3a1f09c2 9e3779b97f4a7c15 18432 data/tables/ships.tbl
+//
+// Archives are named by file name only and paths compare case-insensitively,
+// as the game treats them, so a manifest still matches after the VPs move
+// to another machine.
+struct VPManifestEntry {
+    uint32_t crc32c = 0;
+    uint64_t xxh64 = 0;
+    int32_t size = 0;
+};
+
+using VPManifest = std::map<std::string, std::map<std::string, VPManifestEntry>>; // archive -> path -> digest
+
+inline std::string vp_manifest_key(std::string s) {
+    for (char& c : s)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+inline std::string vp_manifest_archive_name(const std::string& filename) {
+    size_t slash = filename.find_last_of('/');
+    return vp_manifest_key(slash == std::string::npos ? filename : filename.substr(slash + 1));
+}
+
+inline void vp_manifest_write(std::ostream& out, const std::vector<VPVerifyResult>& results) {
+    out << "# vpview manifest 1\n";
+    char line[64];
+    for (const auto& result : results) {
+        out << "archive " << vp_manifest_archive_name(result.archive) << '\n';
+        for (const auto& digest : result.digests) {
+            if (!digest.hashed) continue;
+            std::snprintf(line, sizeof(line), "%08" PRIx32 " %016" PRIx64 " %" PRId32 " ", digest.crc32c,
+                          digest.xxh64, digest.size);
+            out << line << digest.path << '\n';
+        }
+    }
+}
+
+// Returns false, with `error` naming the line, on malformed input.
+inline bool vp_manifest_read(std::istream& in, VPManifest& manifest, std::string& error) {
+    std::string line;
+    std::map<std::string, VPManifestEntry>* current = nullptr;
+    for (size_t line_no = 1; std::getline(in, line); ++line_no) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        if (line.compare(0, 8, "archive ") == 0) {
+            current = &manifest[vp_manifest_key(line.substr(8))];
+            continue;
+        }
+        VPManifestEntry entry;
+        int path_at = 0;
+        if (!current || std::sscanf(line.c_str(), "%8" SCNx32 " %16" SCNx64 " %" SCNd32 " %n", &entry.crc32c,
+                                    &entry.xxh64, &entry.size, &path_at) != 3 || path_at == 0 ||
+            static_cast<size_t>(path_at) >= line.size()) {
+            error = "malformed manifest line " + std::to_string(line_no);
+            return false;
+        }
+        (*current)[vp_manifest_key(line.substr(path_at))] = entry;
+    }
+    return true;
+}
+
+// Adds an issue for every entry whose digest differs from the manifest, is
+// not in it, or is in it but missing from the archive.
+inline void vp_verify_compare(VPVerifyResult& result, const VPManifest& manifest) {
+    auto archive = manifest.find(vp_manifest_archive_name(result.archive));
+    if (archive == manifest.end()) {
+        result.issues.push_back({"", "archive is not in the manifest"});
+        return;
+    }
+    std::map<std::string, bool> seen;
+    for (const auto& digest : result.digests) {
+        std::string key = vp_manifest_key(digest.path);
+        seen[key] = true;
+        if (!digest.hashed) continue; // already reported
+        auto it = archive->second.find(key);
+        if (it == archive->second.end())
+            result.issues.push_back({digest.path, "not in the manifest"});
+        else if (it->second.size != digest.size)
+            result.issues.push_back({digest.path, "size differs from the manifest (" + std::to_string(digest.size) +
+                                                      " vs " + std::to_string(it->second.size) + ")"});
+        else if (it->second.crc32c != digest.crc32c || it->second.xxh64 != digest.xxh64)
+            result.issues.push_back({digest.path, "content differs from the manifest"});
+    }
+    for (const auto& [path, entry] : archive->second)
+        if (!seen.count(path))
+            result.issues.push_back({path, "listed in the manifest but missing from the archive"});
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "vp_parser.h"
+
+// VP paths are case-insensitive in the engine, so the index hashes and
+// compares them ASCII-case-folded rather than storing lowered copies.
+struct VPPathHash {
+    size_t operator()(std::string_view s) const {
+        uint64_t h = 1469598103934665603ull; // FNV-1a
+        for (unsigned char c : s) {
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            h = (h ^ c) * 1099511628211ull;
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+struct VPPathEqual {
+    bool operator()(std::string_view a, std::string_view b) const {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            unsigned char x = a[i], y = b[i];
+            if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+            if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+            if (x != y) return false;
+        }
+        return true;
+    }
+};
+
+struct VPVFSRef {
+    uint32_t archive;
+    uint32_t entry;
+};
+
+// One path of the merged tree. Nodes are stored parent-before-child. The
+// strings point into the first providing archive's entry table.
+struct VPVFSNode {
+    std::string_view name;
+    std::string_view full_path;
+    bool is_dir = false;
+    int parent = -1;
+    std::vector<uint32_t> children;
+    VPVFSRef ref;                  // winning archive/entry
+    std::vector<uint32_t> sources; // every archive providing this path, lowest priority first
+};
+
+// Layered view over several VP archives. Archives with a higher priority
+// override lower ones; equal priorities resolve in mount order, so plain
+// mount() calls behave like the game loading later VPs over earlier ones.
+class VPVFS {
+public:
+    bool mount(const std::string& filename, bool use_mmap = true) {
+        return mount_at(filename, top_priority(), use_mmap);
+    }
+
+    bool mount_at(const std::string& filename, int priority, bool use_mmap = true) {
+        auto parser = std::make_unique<VPParser>();
+        if (!parser->load(filename, use_mmap)) return false;
+        mount_at(std::move(parser), priority);
+        return true;
+    }
+
+    // Mounts an archive that is already loaded, so callers can find out
+    // whether it reads before touching anything that uses the VFS.
+    void mount(std::unique_ptr<VPParser> parser) { mount_at(std::move(parser), top_priority()); }
+
+    void mount_at(std::unique_ptr<VPParser> parser, int priority) {
+        bool on_top = m_priorities.empty() ||
+                      priority >= *std::max_element(m_priorities.begin(), m_priorities.end());
+        m_archives.push_back(std::move(parser));
+        m_priorities.push_back(priority);
+        if (on_top)
+            apply(static_cast<uint32_t>(m_archives.size() - 1));
+        else
+            rebuild();
+    }
+
+    // Priority that puts a new archive above every one mounted so far.
+    int top_priority() const {
+        return m_priorities.empty() ? 0 : *std::max_element(m_priorities.begin(), m_priorities.end());
+    }
+
+    void clear() {
+        m_archives.clear();
+        m_priorities.clear();
+        m_nodes.clear();
+        m_roots.clear();
+        m_index.clear();
+    }
+
+    size_t archive_count() const { return m_archives.size(); }
+    const VPParser& archive(size_t i) const { return *m_archives[i]; }
+    int priority(size_t i) const { return m_priorities[i]; }
+
+    const std::vector<VPVFSNode>& nodes() const { return m_nodes; }
+    const std::vector<uint32_t>& roots() const { return m_roots; }
+    const VPParser& archive(const VPVFSNode& node) const { return *m_archives[node.ref.archive]; }
+    VPEntry entry(const VPVFSNode& node) const {
+        return m_archives[node.ref.archive]->entries[node.ref.entry];
+    }
+
+    // Node for `path` (case-insensitive, '/'-separated), or nullptr.
+    const VPVFSNode* find(std::string_view path) const {
+        auto it = m_index.find(path);
+        return it == m_index.end() ? nullptr : &m_nodes[it->second];
+    }
+
+private:
+    // Layers one archive over the current tree. Only valid when it has the
+    // highest priority so far; otherwise the whole tree is rebuilt.
+    void apply(uint32_t archive) {
+        const auto& entries = m_archives[archive]->entries;
+        m_index.reserve(m_index.size() + entries.size());
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            VPEntry e = entries[i];
+            auto it = m_index.find(e.full_path);
+            if (it != m_index.end()) {
+                VPVFSNode& node = m_nodes[it->second];
+                if (!node.is_dir || e.is_dir)
+                    node.ref = {archive, i};
+                node.is_dir = node.is_dir || e.is_dir;
+                node.sources.push_back(archive);
+                continue;
+            }
+            VPVFSNode node;
+            node.name = e.name;
+            node.full_path = e.full_path;
+            node.is_dir = e.is_dir;
+            node.ref = {archive, i};
+            node.sources.push_back(archive);
+            auto slash = e.full_path.find_last_of('/');
+            if (slash != std::string_view::npos) {
+                auto parent = m_index.find(e.full_path.substr(0, slash));
+                if (parent != m_index.end())
+                    node.parent = static_cast<int>(parent->second);
+            }
+            uint32_t index = static_cast<uint32_t>(m_nodes.size());
+            if (node.parent >= 0)
+                m_nodes[node.parent].children.push_back(index);
+            else
+                m_roots.push_back(index);
+            m_index.emplace(e.full_path, index);
+            m_nodes.push_back(std::move(node));
+        }
+    }
+
+    void rebuild() {
+        m_nodes.clear();
+        m_roots.clear();
+        m_index.clear();
+        std::vector<uint32_t> order(m_archives.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return m_priorities[a] < m_priorities[b];
+        });
+        for (uint32_t a : order)
+            apply(a);
+    }
+
+    std::vector<std::unique_ptr<VPParser>> m_archives;
+    std::vector<int> m_priorities;
+    std::vector<VPVFSNode> m_nodes;
+    std::vector<uint32_t> m_roots;
+    std::unordered_map<std::string_view, uint32_t, VPPathHash, VPPathEqual> m_index;
+};
@@ -1,92 +1,44 @@
 #include <gtkmm.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <gst/gst.h>
-#include <gst/app/gstappsrc.h>
-#include <gst/gstclock.h>
 #include <glibmm/fileutils.h>
 #include <iomanip>
 #include <map>
 #include <vector>
-#include <stack>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
 #include "ani_decoder.h"
+#include "audio_player.h"
+#include "image_view.h"
 #include "pcx_decoder.h"
 #include "pof_decoder.h"
-
-struct VPEntry {
-    int offset;
-    int size;
-    std::string name;
-    int timestamp;
-    bool is_dir = false;
-    std::string full_path;
-};
-
-class VPParser {
-public:
-    bool load(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) return false;
-	this->filename = filename;
-        char header[4];
-        file.read(header, 4);
-        if (std::strncmp(header, "VPVP", 4) != 0) return false;
-
-        int version, diroffset, direntries;
-        file.read(reinterpret_cast<char*>(&version), sizeof(version));
-        file.read(reinterpret_cast<char*>(&diroffset), sizeof(diroffset));
-        file.read(reinterpret_cast<char*>(&direntries), sizeof(direntries));
-
-        entries.clear();
-        file.seekg(diroffset, std::ios::beg);
-
-        std::stack<std::string> path_stack;
-        path_stack.push(""); // root
-
-        for (int i = 0; i < direntries; ++i) {
-            VPEntry entry;
-            file.read(reinterpret_cast<char*>(&entry.offset), sizeof(entry.offset));
-            file.read(reinterpret_cast<char*>(&entry.size), sizeof(entry.size));
-
-            char name[32];
-            file.read(name, 32);
-            entry.name = name;
-
-            file.read(reinterpret_cast<char*>(&entry.timestamp), sizeof(entry.timestamp));
-
-            if (entry.name == "..") {
-                path_stack.pop();
-                continue;
-            }
-
-            entry.is_dir = (entry.size == 0);
-            std::string current_path = path_stack.top();
-            if (!current_path.empty()) current_path += "/";
-            current_path += entry.name;
-            entry.full_path = current_path;
-
-            if (entry.is_dir) {
-                path_stack.push(current_path);
-            }
-
-            entries.push_back(entry);
-        }
-
-        this->file = std::move(file);
-        return true;
-    }
-    std::string filename;
-    std::vector<VPEntry> entries;
-    std::ifstream file;
-};
+#include "pof_render.h"
+#include "preview_worker.h"
+#include "text_scan.h"
+#include "thumbnail_worker.h"
+#include "vp_cli.h"
+#include "vp_extract.h"
+#include "vp_parser.h"
+#include "vp_search.h"
+#include "vp_trace.h"
+#include "vp_verify.h"
+#include "vp_vfs.h"
 
 class VPViewerWindow : public Gtk::Window {
 public:
     VPViewerWindow()
-    : m_box(Gtk::ORIENTATION_VERTICAL), m_paned(Gtk::ORIENTATION_HORIZONTAL) {
+    : m_box(Gtk::ORIENTATION_VERTICAL), m_paned(Gtk::ORIENTATION_HORIZONTAL), m_text_page(Gtk::ORIENTATION_HORIZONTAL),
+      m_left_box(Gtk::ORIENTATION_VERTICAL), m_left_paned(Gtk::ORIENTATION_VERTICAL),
+      m_preview(preview_cache_budget()) {
         set_title("VP Viewer");
         set_default_size(800, 600);
 
@@ -95,10 +47,15 @@ public:
         auto file_menu = Gtk::make_managed<Gtk::Menu>();
 
         auto open_item = Gtk::make_managed<Gtk::MenuItem>("Open");
-        open_item->signal_activate().connect(sigc::mem_fun(*this, &VPViewerWindow::on_open_file));
+        open_item->signal_activate().connect([this]() { on_open_file(false); });
         file_menu->append(*open_item);
         open_item->show();
 
+        auto mount_item = Gtk::make_managed<Gtk::MenuItem>("Add Archive");
+        mount_item->signal_activate().connect([this]() { on_open_file(true); });
+        file_menu->append(*mount_item);
+        mount_item->show();
+
         auto extract_item = Gtk::make_managed<Gtk::MenuItem>("Extract");
         extract_item->signal_activate().connect(sigc::mem_fun(*this, &VPViewerWindow::on_extract_file));
         file_menu->append(*extract_item);
@@ -109,6 +66,21 @@ public:
         file_menu->append(*extract_all_item);
         extract_all_item->show();
 
+        auto verify_item = Gtk::make_managed<Gtk::MenuItem>("Verify");
+        verify_item->signal_activate().connect([this]() { on_verify(false, false); });
+        file_menu->append(*verify_item);
+        verify_item->show();
+
+        auto verify_manifest_item = Gtk::make_managed<Gtk::MenuItem>("Verify Against Manifest");
+        verify_manifest_item->signal_activate().connect([this]() { on_verify(true, false); });
+        file_menu->append(*verify_manifest_item);
+        verify_manifest_item->show();
+
+        auto export_manifest_item = Gtk::make_managed<Gtk::MenuItem>("Export Manifest");
+        export_manifest_item->signal_activate().connect([this]() { on_verify(false, true); });
+        file_menu->append(*export_manifest_item);
+        export_manifest_item->show();
+
         auto quit_item = Gtk::make_managed<Gtk::MenuItem>("Quit");
         quit_item->signal_activate().connect([this]() { hide(); });
         file_menu->append(*quit_item);
@@ -122,199 +94,344 @@ public:
         m_box.pack_start(m_menubar, Gtk::PACK_SHRINK);
         m_box.pack_start(m_paned);
 
+        m_status.set_xalign(0.0f);
+        m_cancel_button.set_label("Cancel");
+        m_cancel_button.signal_clicked().connect([this]() {
+            if (m_extract_progress)
+                m_extract_progress->cancel = true;
+            if (m_verify_progress)
+                m_verify_progress->cancel = true;
+        });
+        m_status_box.pack_start(m_status);
+        m_status_box.pack_start(m_progress, Gtk::PACK_SHRINK);
+        m_status_box.pack_start(m_cancel_button, Gtk::PACK_SHRINK);
+        m_box.pack_start(m_status_box, Gtk::PACK_SHRINK);
+        m_extract_done.connect(sigc::mem_fun(*this, &VPViewerWindow::on_extract_finished));
+        m_verify_done.connect(sigc::mem_fun(*this, &VPViewerWindow::on_verify_finished));
+        m_preview.signal_ready().connect(sigc::mem_fun(*this, &VPViewerWindow::on_preview_ready));
+
         m_treestore = Gtk::TreeStore::create(m_columns);
         m_treeview.set_model(m_treestore);
         m_treeview.append_column("Filename", m_columns.m_col_name);
+        m_treeview.append_column("Source", m_columns.m_col_source);
         m_treeview.get_selection()->signal_changed().connect(sigc::mem_fun(*this, &VPViewerWindow::on_tree_selection_changed));
+        m_treeview.signal_test_expand_row().connect(sigc::mem_fun(*this, &VPViewerWindow::on_test_expand_row), false);
 		m_treeview_scroll.add(m_treeview);
 		m_treeview_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
 
-		m_drawing_area.signal_draw().connect(sigc::mem_fun(*this, &VPViewerWindow::on_draw_pcx));
-		m_drawing_area.signal_draw().connect(sigc::mem_fun(*this, &VPViewerWindow::on_draw_ani));
-
-        m_paned.pack1(m_treeview_scroll);
+		m_model_area.signal_draw().connect(sigc::mem_fun(*this, &VPViewerWindow::on_draw_pof));
+		m_model_area.add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON1_MOTION_MASK | Gdk::SCROLL_MASK);
+		m_model_area.signal_button_press_event().connect(sigc::mem_fun(*this, &VPViewerWindow::on_pof_button_press));
+		m_model_area.signal_motion_notify_event().connect(sigc::mem_fun(*this, &VPViewerWindow::on_pof_motion));
+		m_model_area.signal_scroll_event().connect(sigc::mem_fun(*this, &VPViewerWindow::on_pof_scroll));
+
+        m_search_entry.set_placeholder_text("Search file contents");
+        m_search_entry.signal_activate().connect(sigc::mem_fun(*this, &VPViewerWindow::on_search));
+        m_search_ready.connect(sigc::mem_fun(*this, &VPViewerWindow::on_search_ready));
+        m_results = Gtk::ListStore::create(m_result_columns);
+        m_results_view.set_model(m_results);
+        m_results_view.append_column("File", m_result_columns.m_col_path);
+        m_results_view.append_column("Line", m_result_columns.m_col_line);
+        m_results_view.append_column("Text", m_result_columns.m_col_text);
+        m_results_view.signal_row_activated().connect(sigc::mem_fun(*this, &VPViewerWindow::on_search_result_activated));
+        m_results_scroll.add(m_results_view);
+        m_results_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+        m_left_paned.pack1(m_treeview_scroll, true, false);
+        m_left_paned.pack2(m_results_scroll, true, false);
+        m_search_regex.set_label("Regex");
+        m_search_regex.signal_toggled().connect(sigc::mem_fun(*this, &VPViewerWindow::on_search));
+        m_search_box.pack_start(m_search_entry);
+        m_search_box.pack_start(m_search_regex, Gtk::PACK_SHRINK);
+        m_left_box.pack_start(m_search_box, Gtk::PACK_SHRINK);
+        m_left_box.pack_start(m_left_paned);
+        m_paned.pack1(m_left_box);
 		m_text_view.set_editable(false);
 		m_text_scroll.add(m_text_view);
 		m_text_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
-
-		m_stack.add(m_text_scroll, "text");
-		m_stack.add(m_drawing_area, "image");
-//		m_stack.add(m_ani_widget, "animation");
+        create_text_tags();
+        m_outline = Gtk::ListStore::create(m_outline_columns);
+        m_outline_view.set_model(m_outline);
+        m_outline_view.append_column("Outline", m_outline_columns.m_col_label);
+        m_outline_view.get_selection()->signal_changed().connect(sigc::mem_fun(*this, &VPViewerWindow::on_outline_selected));
+        m_outline_scroll.add(m_outline_view);
+        m_outline_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+        m_outline_scroll.set_size_request(180, -1);
+        m_text_page.pack1(m_outline_scroll, false, false);
+        m_text_page.pack2(m_text_scroll, true, false);
+
+		m_stack.add(m_text_page, "text");
+		m_stack.add(m_image_view, "image");
+		m_stack.add(m_model_area, "model");
+		build_audio_grid();
 		m_stack.add(m_grid, "wave");
+        m_thumb_store = Gtk::ListStore::create(m_thumb_columns);
+        m_thumb_view.set_model(m_thumb_store);
+        m_thumb_view.set_pixbuf_column(m_thumb_columns.m_col_pixbuf);
+        m_thumb_view.set_text_column(m_thumb_columns.m_col_name);
+        m_thumb_view.set_item_width(m_thumbs.size());
+        m_thumb_view.signal_item_activated().connect(sigc::mem_fun(*this, &VPViewerWindow::on_thumbnail_activated));
+        m_thumbs.signal_ready().connect(sigc::mem_fun(*this, &VPViewerWindow::on_thumbnails_ready));
+        m_thumb_scroll.add(m_thumb_view);
+        m_thumb_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+        m_stack.add(m_thumb_scroll, "thumbnails");
+        m_loading_box.set_spacing(6);
+        m_loading_box.set_halign(Gtk::ALIGN_CENTER);
+        m_loading_box.pack_start(m_spinner, Gtk::PACK_SHRINK);
+        m_loading_box.pack_start(m_loading_label, Gtk::PACK_SHRINK);
+        m_stack.add(m_loading_box, "loading");
 		m_paned.pack2(m_stack);
         show_all_children();
+        m_progress.hide();
+        m_cancel_button.hide();
+        m_results_scroll.hide();
+        m_outline_scroll.hide();
     }
 
-    bool on_draw_pcx(const Cairo::RefPtr<Cairo::Context>& cr) {
-        if (m_current_pixbuf) {
-            Gdk::Cairo::set_source_pixbuf(cr, m_current_pixbuf, 0, 0);
-            cr->paint();
+    ~VPViewerWindow() override {
+        stop_search();
+        if (m_extract_thread.joinable()) {
+            m_extract_progress->cancel = true;
+            m_extract_thread.join();
         }
-        return true;
-    }
-
-	bool on_draw_ani(const Cairo::RefPtr<Cairo::Context>& cr) {
-	    if (m_current_pixbuf)
-	        Gdk::Cairo::set_source_pixbuf(cr, m_current_pixbuf, 0, 0), cr->paint();
-	    return true;
-	}
-
-protected:
-    void on_play_clicked(const VPEntry& entry) {
-        if (!load_audio_data(entry))
-            return;
-
-	//Check if currently playing and then clear the pipeline
-	GstState current_state;
-	gst_element_get_state(m_pipeline, &current_state, nullptr, GST_CLOCK_TIME_NONE);
-
-	if (current_state == GST_STATE_PLAYING) {
-	    // Clear pipeline
-	    gst_element_set_state(m_pipeline, GST_STATE_NULL);
-	    gst_object_unref(m_pipeline);
-	    m_pipeline = nullptr;
-	}
-
-        // Create GStreamer elements
-        m_pipeline = gst_pipeline_new("vp-pipeline");
-        GstElement* appsrc = gst_element_factory_make("appsrc", "source");
-        GstElement* decodebin = gst_element_factory_make("decodebin", "decode");
-        GstElement* convert = gst_element_factory_make("audioconvert", "convert");
-        GstElement* sink = gst_element_factory_make("autoaudiosink", "sink");
-
-        if (!m_pipeline || !appsrc || !decodebin || !convert || !sink) {
-            std::cerr << "Failed to create one or more GStreamer elements." << std::endl;
-            return;
+        if (m_verify_thread.joinable()) {
+            m_verify_progress->cancel = true;
+            m_verify_thread.join();
         }
-
-        // Assemble pipeline
-        gst_bin_add_many(GST_BIN(m_pipeline), appsrc, decodebin, convert, sink, nullptr);
-        gst_element_link(appsrc, decodebin);
-        g_signal_connect(decodebin, "pad-added", G_CALLBACK(on_pad_added), convert);
-        gst_element_link(convert, sink);
-
-        // Configure appsrc
-        GstAppSrc* appsrc_cast = GST_APP_SRC(appsrc);
-        gst_app_src_set_stream_type(appsrc_cast, GST_APP_STREAM_TYPE_STREAM);
-        gst_app_src_set_size(appsrc_cast, m_audio_data.size());
-
-        // WAV type
-        GstCaps* caps = gst_caps_new_simple("audio/x-wav", nullptr);
-        gst_app_src_set_caps(appsrc_cast, caps);
-        gst_caps_unref(caps);
-
-        // Push the buffer
-        GstBuffer* buffer = gst_buffer_new_allocate(nullptr, m_audio_data.size(), nullptr);
-        gst_buffer_fill(buffer, 0, m_audio_data.data(), m_audio_data.size());
-        gst_app_src_push_buffer(appsrc_cast, buffer);
-        gst_app_src_end_of_stream(appsrc_cast);
-
-        // Start playback
-        gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+        if (std::getenv("VPVIEW_CACHE_STATS"))
+            std::cerr << cache_stats_text() << std::endl;
     }
 
-    void on_pause_clicked() {
-        gst_element_set_state(m_pipeline, GST_STATE_PAUSED);
+    // Renders the model at the widget's size on every draw; the surface is
+    // only reallocated when the size changes.
+    bool on_draw_pof(const Cairo::RefPtr<Cairo::Context>& cr) {
+        if (!m_pof_shown)
+            return true;
+        VPTraceScope trace("POF render");
+        int width = m_model_area.get_allocated_width();
+        int height = m_model_area.get_allocated_height();
+        if (!m_pof_surface || m_pof_surface->get_width() != width || m_pof_surface->get_height() != height)
+            m_pof_surface = Cairo::ImageSurface::create(Cairo::FORMAT_RGB24, width, height);
+        m_pof_surface->flush();
+        m_pof_renderer.render(reinterpret_cast<uint32_t*>(m_pof_surface->get_data()), width, height,
+                              m_pof_surface->get_stride(), m_pof_camera, m_pof_mode);
+        m_pof_surface->mark_dirty();
+        cr->set_source(m_pof_surface, 0, 0);
+        cr->paint();
+        return true;
     }
 
-    void on_stop_clicked() {
-        gst_element_set_state(m_pipeline, GST_STATE_READY);
+    // Drag to rotate, scroll to zoom, double-click to toggle wireframe.
+    bool on_pof_button_press(GdkEventButton* event) {
+        if (!m_pof_shown) return false;
+        if (event->type == GDK_2BUTTON_PRESS) {
+            m_pof_mode = m_pof_mode == POFRenderMode::Flat ? POFRenderMode::Wireframe : POFRenderMode::Flat;
+            m_model_area.queue_draw();
+        }
+        m_drag_x = event->x;
+        m_drag_y = event->y;
+        return true;
     }
 
-    void on_restart_clicked() {
-        gst_element_set_state(m_pipeline, GST_STATE_READY);
-        gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+    bool on_pof_motion(GdkEventMotion* event) {
+        if (!m_pof_shown) return false;
+        m_pof_camera.yaw += static_cast<float>(event->x - m_drag_x) * 0.01f;
+        m_pof_camera.pitch += static_cast<float>(event->y - m_drag_y) * 0.01f;
+        m_drag_x = event->x;
+        m_drag_y = event->y;
+        m_model_area.queue_draw();
+        return true;
     }
 
-    bool load_audio_data(VPEntry entry) {
-        std::ifstream file(m_parser.filename, std::ios::binary);
-            std::cerr << "File: " << entry.name << std::endl;
-            std::cerr << "File: " << entry.offset << std::endl;
-            std::cerr << "File: " << entry.size << std::endl;
-
-        if (!file) {
-            std::cerr << "Failed to open: " << entry.name << std::endl;
-            return false;
-        }
-
-        file.seekg(0, std::ios::end);
-        size_t total_size = file.tellg();
-        if (entry.offset + entry.size > total_size) {
-            std::cerr << "Invalid VPEntry offset/size (out of bounds)." << std::endl;
-            return false;
-        }
-
-        file.seekg(entry.offset);
-        m_audio_data.resize(entry.size);
-        file.read(reinterpret_cast<char*>(m_audio_data.data()), entry.size);
-
+    bool on_pof_scroll(GdkEventScroll* event) {
+        if (!m_pof_shown) return false;
+        if (event->direction == GDK_SCROLL_UP)
+            m_pof_camera.zoom *= 1.1f;
+        else if (event->direction == GDK_SCROLL_DOWN)
+            m_pof_camera.zoom /= 1.1f;
+        m_model_area.queue_draw();
         return true;
     }
 
-    bool on_timeout() {
-        if (!GST_IS_ELEMENT(m_playbin))
-            return true;
-
-        gint64 pos = 0;
-        gint64 dur = 0;
+protected:
+    // The grid only ever names the selected entry; Play loads it into the
+    // player if it is not the one already there.
+    void on_play_clicked() {
+        if (m_audio_selected < 0) return;
+        if (m_audio_loaded != m_audio_selected) {
+            const auto& node = m_vfs.nodes()[m_audio_selected];
+            if (!m_audio.set_source(m_vfs.archive(node), m_vfs.entry(node))) {
+                std::cerr << "Invalid VPEntry offset/size (out of bounds)." << std::endl;
+                return;
+            }
+            m_audio_loaded = m_audio_selected;
+        }
+        m_audio.play();
+    }
 
-        if (gst_element_query_position(m_pipeline, GST_FORMAT_TIME, &pos) &&
-            gst_element_query_duration(m_pipeline, GST_FORMAT_TIME, &dur)) {
-            double current_sec = (double)pos / GST_SECOND;
-            double total_sec = (double)dur / GST_SECOND;
+    void on_pause_clicked() { m_audio.pause(); }
+    void on_stop_clicked() { m_audio.stop(); }
+    void on_restart_clicked() { m_audio.restart(); }
 
+    bool on_timeout() {
+        double current_sec, total_sec;
+        if (m_audio_loaded >= 0 && m_stack.get_visible_child() == &m_grid &&
+            m_audio.query(current_sec, total_sec)) {
             m_adjustment->set_upper(total_sec);
             m_adjustment->set_value(current_sec);
         }
-
         return true; // keep timer
     }
 
-    static void on_pad_added(GstElement* src, GstPad* pad, gpointer data) {
-        GstElement* convert = static_cast<GstElement*>(data);
-        GstPad* sinkpad = gst_element_get_static_pad(convert, "sink");
-        if (gst_pad_link(pad, sinkpad) != GST_PAD_LINK_OK)
-            std::cerr << "Failed to link decodebin to audioconvert" << std::endl;
-        gst_object_unref(sinkpad);
+    void build_audio_grid() {
+        m_label.set_text("Filename:");
+        m_grid.attach(m_label, 0, 0, 4, 1); // column, row, width, height
+
+        m_scrollbar.set_orientation(Gtk::ORIENTATION_HORIZONTAL);
+        m_adjustment = Gtk::Adjustment::create(0, 0, 100, 1, 10);
+        m_scrollbar.set_adjustment(m_adjustment);
+        m_grid.attach(m_scrollbar, 0, 1, 4, 1);
+
+        m_button_play.set_label("Play");
+        m_button_pause.set_label("Pause");
+        m_button_stop.set_label("Stop");
+        m_button_restart.set_label("Restart");
+        m_grid.attach(m_button_play, 0, 2, 1, 1);
+        m_grid.attach(m_button_pause, 1, 2, 1, 1);
+        m_grid.attach(m_button_stop, 2, 2, 1, 1);
+        m_grid.attach(m_button_restart, 3, 2, 1, 1);
+
+        m_button_play.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_play_clicked));
+        m_button_pause.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_pause_clicked));
+        m_button_stop.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_stop_clicked));
+        m_button_restart.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_restart_clicked));
+        Glib::signal_timeout().connect(sigc::mem_fun(*this, &VPViewerWindow::on_timeout), 100);
     }
-//    VPEntry m_entry;
-    GstElement* m_pipeline = nullptr;
-    std::vector<uint8_t> m_audio_data;
 
 private:
     class ModelColumns : public Gtk::TreeModel::ColumnRecord {
     public:
-        ModelColumns() { add(m_col_name); add(m_col_index); }
+        ModelColumns() { add(m_col_name); add(m_col_index); add(m_col_source); }
         Gtk::TreeModelColumn<Glib::ustring> m_col_name;
-        Gtk::TreeModelColumn<int> m_col_index;
+        Gtk::TreeModelColumn<int> m_col_index; // VPVFS node
+        Gtk::TreeModelColumn<Glib::ustring> m_col_source;
     } m_columns;
 
+    class ResultColumns : public Gtk::TreeModel::ColumnRecord {
+    public:
+        ResultColumns() { add(m_col_path); add(m_col_line); add(m_col_text); add(m_col_index); }
+        Gtk::TreeModelColumn<Glib::ustring> m_col_path;
+        Gtk::TreeModelColumn<unsigned> m_col_line;
+        Gtk::TreeModelColumn<Glib::ustring> m_col_text;
+        Gtk::TreeModelColumn<int> m_col_index; // VPVFS node
+    } m_result_columns;
+
+    class ThumbColumns : public Gtk::TreeModel::ColumnRecord {
+    public:
+        ThumbColumns() { add(m_col_pixbuf); add(m_col_name); add(m_col_index); }
+        Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf>> m_col_pixbuf;
+        Gtk::TreeModelColumn<Glib::ustring> m_col_name;
+        Gtk::TreeModelColumn<int> m_col_index; // VPVFS node
+    } m_thumb_columns;
+
+    class OutlineColumns : public Gtk::TreeModel::ColumnRecord {
+    public:
+        OutlineColumns() { add(m_col_label); add(m_col_line); }
+        Gtk::TreeModelColumn<Glib::ustring> m_col_label;
+        Gtk::TreeModelColumn<unsigned> m_col_line; // from 0
+    } m_outline_columns;
+
     Gtk::Box m_box;
     Gtk::MenuBar m_menubar;
     Gtk::Paned m_paned;
     Gtk::TreeView m_treeview;
     Gtk::Stack m_stack;
     Gtk::ScrolledWindow m_text_scroll;
+    Gtk::Paned m_text_page; // outline | text
+    Gtk::ScrolledWindow m_outline_scroll;
+    Gtk::TreeView m_outline_view;
+    Glib::RefPtr<Gtk::ListStore> m_outline;
     Gtk::ScrolledWindow m_treeview_scroll;
+    Gtk::Box m_left_box;
+    Gtk::Box m_search_box;
+    Gtk::SearchEntry m_search_entry;
+    Gtk::CheckButton m_search_regex;
+    Gtk::Paned m_left_paned;
+    Gtk::TreeView m_results_view;
+    Gtk::ScrolledWindow m_results_scroll;
+    Glib::RefPtr<Gtk::ListStore> m_results;
     Gtk::TextView m_text_view;
-    Gtk::DrawingArea m_drawing_area;
+    Glib::RefPtr<Gtk::TextTag> m_text_tags[text_style_count];
+    std::shared_ptr<const PreviewResult> m_text_shown; // still being filled in
+    size_t m_text_filled = 0;   // bytes of its text in the buffer
+    size_t m_spans_applied = 0; // of its scan.spans
+    sigc::connection m_text_fill;
+    ImageView m_image_view;
+    Gtk::ScrolledWindow m_thumb_scroll;
+    Gtk::IconView m_thumb_view;
+    Glib::RefPtr<Gtk::ListStore> m_thumb_store;
+    std::map<uint32_t, Gtk::TreeModel::iterator> m_thumb_rows; // VPVFS node -> grid item
+    Glib::RefPtr<Gdk::Pixbuf> m_thumb_placeholder;
+    Gtk::DrawingArea m_model_area;
     Gtk::Grid m_grid;
     Gtk::Label m_label;
     Gtk::Scrollbar m_scrollbar;
     Gtk::Button m_button_play, m_button_pause, m_button_stop, m_button_restart;
-    GstElement* m_playbin = nullptr;
-//    ANIMovie ani;
-    PCXImage pcx;
+    Gtk::Box m_status_box;
+    Gtk::Label m_status;
+    Gtk::ProgressBar m_progress;
+    Gtk::Button m_cancel_button;
+    Gtk::Box m_loading_box;
+    Gtk::Spinner m_spinner;
+    Gtk::Label m_loading_label;
+    sigc::connection m_loading_timer;
+    ANIMovie m_ani;
+    sigc::connection m_ani_timer;
+    gint64 m_ani_start = 0;
+    int m_ani_shown = -1;
+    POFModel m_pof;
+    POFRenderer m_pof_renderer;
+    POFCamera m_pof_camera;
+    POFRenderMode m_pof_mode = POFRenderMode::Flat;
+    Cairo::RefPtr<Cairo::ImageSurface> m_pof_surface;
+    bool m_pof_shown = false;
+    double m_drag_x = 0.0, m_drag_y = 0.0;
     bool m_uri_set = false;
     Glib::ustring filename_only;
     std::string title;
     Glib::RefPtr<Gtk::Adjustment> m_adjustment;
     Glib::RefPtr<Gtk::TreeStore> m_treestore;
-    Glib::RefPtr<Gdk::Pixbuf> m_current_pixbuf;
-    VPParser m_parser;
-
-    void on_open_file() {
-        Gtk::FileChooserDialog dialog(*this, "Open .vp File", Gtk::FILE_CHOOSER_ACTION_OPEN);
+    VPVFS m_vfs;
+    PreviewWorker m_preview; // after m_vfs: it must stop reading before the archives go away
+    ThumbnailLoader m_thumbs; // likewise
+    AudioPlayer m_audio; // keeps its own reference to the entry it plays
+    int m_audio_selected = -1; // VFS node shown in the audio grid
+    int m_audio_loaded = -1;   // VFS node the player's source points at
+    std::vector<uint8_t> m_scratch;
+    std::thread m_extract_thread;
+    std::unique_ptr<VPExtractProgress> m_extract_progress;
+    VPExtractResult m_extract_result;
+    Glib::Dispatcher m_extract_done;
+    sigc::connection m_extract_timer;
+    std::thread m_verify_thread;
+    std::unique_ptr<VPVerifyProgress> m_verify_progress;
+    std::vector<VPVerifyResult> m_verify_results;
+    std::string m_verify_export_path;
+    Glib::Dispatcher m_verify_done;
+    sigc::connection m_verify_timer;
+    std::thread m_search_thread;
+    std::unique_ptr<VPSearchProgress> m_search_progress;
+    std::mutex m_search_mutex;                // guards the two below
+    std::vector<VPSearchHit> m_search_pending; // hits not yet in m_results
+    bool m_search_finished = false;
+    VPSearchResult m_search_result;
+    Glib::Dispatcher m_search_ready;
+    size_t m_search_shown = 0;
+    int m_reveal_node = -1; // search hit being opened, and its line
+    unsigned m_reveal_line = 0;
+
+    // Opens an archive, or with `add` mounts it over the ones already open.
+    void on_open_file(bool add) {
+        Gtk::FileChooserDialog dialog(*this, add ? "Add .vp File" : "Open .vp File", Gtk::FILE_CHOOSER_ACTION_OPEN);
         dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
         dialog.add_button("Open", Gtk::RESPONSE_OK);
 
@@ -322,198 +439,866 @@ private:
         filter_vp->set_name("VP files");
         filter_vp->add_pattern("*vp");
         dialog.add_filter(filter_vp);
+        if (m_extract_thread.joinable() || m_verify_thread.joinable()) {
+            m_status.set_text("Wait for the extraction or verification to finish before opening another archive.");
+            return;
+        }
         if (dialog.run() == Gtk::RESPONSE_OK) {
-            if (m_parser.load(dialog.get_filename())) {
-                m_treestore->clear();
-                std::map<std::string, Gtk::TreeModel::Row> dir_map;
-
-                for (size_t i = 0; i < m_parser.entries.size(); ++i) {
-                    const auto& entry = m_parser.entries[i];
-                    std::string parent_path = entry.full_path.substr(0, entry.full_path.find_last_of("/"));
-                    Gtk::TreeModel::Row parent;
-
-                    if (!parent_path.empty() && dir_map.count(parent_path)) {
-                        parent = dir_map[parent_path];
-                    }
-
-                    Gtk::TreeModel::Row row;
-                    if (parent) {
-                        row = *(m_treestore->append(parent.children()));
-                    } else {
-                        row = *(m_treestore->append());
-                    }
-
-                    row[m_columns.m_col_name] = entry.name;
-                    row[m_columns.m_col_index] = static_cast<int>(i);
-
-                    if (entry.is_dir) {
-                        dir_map[entry.full_path] = row;
-                    }
-                }
+            std::string full_path = dialog.get_filename();
+            VPTraceScope trace("open archive");
+            trace.set_detail(full_path);
+            // The archive is loaded before anything is torn down, so a
+            // failed Open or Add leaves the tree, its node indices, the
+            // running search and the thumbnail grid as they were.
+            auto parser = std::make_unique<VPParser>();
+            if (!parser->load(full_path)) {
+                m_status.set_text("Could not read " + full_path);
+                return;
             }
-        std::string full_path = dialog.get_filename();
+            stop_search(); // it reads through m_vfs
+            clear_thumbnails();
+            if (!add) {
+                m_preview.cancel_and_wait();
+                m_vfs.clear();
+            }
+            m_vfs.mount(std::move(parser));
+            // Mounting renumbers the VFS nodes; whatever is playing keeps playing.
+            m_audio_selected = m_audio_loaded = -1;
+            // An animation or model from the old tree must not stay up.
+            m_preview.cancel();
+            m_loading_timer.disconnect();
+            stop_animation();
+            m_pof_shown = false;
+            m_image_view.clear();
+            show_message("");
+            populate_tree();
+
         // Extract just the filename from the full path
 	filename_only = Glib::filename_display_basename(full_path);
 	title = "VP Viewer - " + filename_only;
+            if (m_vfs.archive_count() > 1)
+                title += " (+" + std::to_string(m_vfs.archive_count() - 1) + " more)";
         set_title(title);
         }
     }
 
+    // Shows the top level of the merged VFS. Directory rows get a single
+    // placeholder child (index -1) so they are expandable; their real
+    // children are only appended in on_test_expand_row, so opening costs the
+    // same however many entries the archives hold.
+    void populate_tree() {
+        VPTraceScope trace("populate_tree");
+        m_treestore->clear();
+        for (uint32_t i : m_vfs.roots())
+            append_node_row(m_treestore->children(), i);
+    }
+
+    void append_node_row(const Gtk::TreeNodeChildren& parent, uint32_t index) {
+        const auto& node = m_vfs.nodes()[index];
+        Gtk::TreeModel::Row row = *(m_treestore->append(parent));
+        row[m_columns.m_col_name] = std::string(node.name);
+        row[m_columns.m_col_index] = static_cast<int>(index);
+        if (!node.is_dir)
+            row[m_columns.m_col_source] = source_label(node);
+        if (!node.children.empty()) {
+            Gtk::TreeModel::Row placeholder = *(m_treestore->append(row.children()));
+            placeholder[m_columns.m_col_index] = -1;
+        }
+    }
+
+    bool on_test_expand_row(const Gtk::TreeModel::iterator& iter, const Gtk::TreeModel::Path&) {
+        auto children = iter->children();
+        if (children.empty())
+            return false;
+        auto placeholder = children.begin();
+        int first = (*placeholder)[m_columns.m_col_index];
+        if (first != -1)
+            return false; // already populated
+
+        int index = (*iter)[m_columns.m_col_index];
+        for (uint32_t child : m_vfs.nodes()[index].children)
+            append_node_row(children, child);
+        m_treestore->erase(placeholder);
+        return false;
+    }
+
+    // "b.vp", or "b.vp (overrides a.vp)" when lower-priority archives also
+    // provide the path.
+    Glib::ustring source_label(const VPVFSNode& node) const {
+        Glib::ustring label = Glib::filename_display_basename(m_vfs.archive(node).filename);
+        if (node.sources.size() > 1) {
+            label += " (overrides ";
+            for (size_t i = 0; i + 1 < node.sources.size(); ++i) {
+                if (i > 0) label += ", ";
+                label += Glib::filename_display_basename(m_vfs.archive(node.sources[i]).filename);
+            }
+            label += ")";
+        }
+        return label;
+    }
+
     void on_extract_file() {
         auto iter = m_treeview.get_selection()->get_selected();
         if (!iter) return;
         int index = (*iter)[m_columns.m_col_index];
-        const auto& entry = m_parser.entries[index];
+        if (index < 0) return;
+        const auto& node = m_vfs.nodes()[index];
+        const auto& entry = m_vfs.entry(node);
 
-        if (entry.size > 0) {
+        if (!node.is_dir && entry.size > 0) {
             Gtk::FileChooserDialog dialog(*this, "Save Extracted File", Gtk::FILE_CHOOSER_ACTION_SAVE);
-            dialog.set_current_name(entry.name);
+            dialog.set_current_name(std::string(entry.name));
             dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
             dialog.add_button("Save", Gtk::RESPONSE_OK);
 
             if (dialog.run() == Gtk::RESPONSE_OK) {
                 std::ofstream out(dialog.get_filename(), std::ios::binary);
-                if (out) {
-                    m_parser.file.seekg(entry.offset);
-                    std::vector<char> buffer(entry.size);
-                    m_parser.file.read(buffer.data(), entry.size);
-                    out.write(buffer.data(), entry.size);
+                VPView data = m_vfs.archive(node).read(entry, m_scratch);
+                if (out && !data.empty()) {
+                    out.write(data.chars(), data.size);
                 }
             }
         }
     }
 
     void on_extract_all() {
+        if (m_extract_thread.joinable()) return;
+
         Gtk::FileChooserDialog dialog(*this, "Select Folder to Extract All Files", Gtk::FILE_CHOOSER_ACTION_SELECT_FOLDER);
         dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
         dialog.add_button("Select", Gtk::RESPONSE_OK);
 
         if (dialog.run() == Gtk::RESPONSE_OK) {
             std::string base_path = dialog.get_filename();
-            for (const auto& entry : m_parser.entries) {
-                if (entry.size > 0) {
-                    std::filesystem::path full_path = base_path + "/" + entry.full_path;
-                    std::filesystem::create_directories(full_path.parent_path());
-                    std::ofstream out(full_path, std::ios::binary);
-                    if (out) {
-                        m_parser.file.seekg(entry.offset);
-                        std::vector<char> buffer(entry.size);
-                        m_parser.file.read(buffer.data(), entry.size);
-                        out.write(buffer.data(), entry.size);
-                    }
+            dialog.hide();
+
+            m_extract_progress = std::make_unique<VPExtractProgress>();
+            m_progress.set_fraction(0.0);
+            m_progress.set_show_text(true);
+            m_progress.show();
+            m_cancel_button.show();
+            m_status.set_text("Extracting to " + base_path);
+
+            // Only the winning copy of each path is written. Archives stay
+            // mounted because on_open_file refuses to run until this is done.
+            std::vector<std::vector<size_t>> winners(m_vfs.archive_count());
+            for (const auto& node : m_vfs.nodes()) {
+                if (!node.is_dir)
+                    winners[node.ref.archive].push_back(node.ref.entry);
+            }
+            m_extract_thread = std::thread([this, base_path, winners = std::move(winners)]() {
+                VPExtractResult total;
+                for (size_t a = 0; a < winners.size() && !m_extract_progress->cancel; ++a) {
+                    if (winners[a].empty()) continue;
+                    VPExtractResult r = vp_extract(m_vfs.archive(a), winners[a], base_path, *m_extract_progress);
+                    total.files += r.files;
+                    total.failed += r.failed;
+                    total.bytes += r.bytes;
+                    total.seconds += r.seconds;
+                    total.cancelled = r.cancelled;
                 }
+                m_extract_result = total;
+                m_extract_done.emit();
+            });
+            m_extract_timer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &VPViewerWindow::on_extract_tick), 100);
+        }
+    }
+
+    bool on_extract_tick() {
+        show_progress(*m_extract_progress);
+        return true;
+    }
+
+    // Works for any of the progress structs; they share their counters.
+    template <typename Progress>
+    void show_progress(const Progress& progress) {
+        if (progress.bytes_total > 0)
+            m_progress.set_fraction(static_cast<double>(progress.bytes_done) / progress.bytes_total);
+        m_progress.set_text(std::to_string(progress.files_done.load()) + " / " + std::to_string(progress.files_total.load()));
+    }
+
+    // Hashes every mounted archive in the background. With `compare` the
+    // hashes are checked against a manifest chosen first; with `export_to`
+    // they are saved as one afterwards. Problems end up in the text view.
+    void on_verify(bool compare, bool export_to) {
+        if (m_extract_thread.joinable() || m_verify_thread.joinable() || m_vfs.archive_count() == 0) return;
+
+        VPManifest manifest;
+        std::string export_path;
+        if (compare || export_to) {
+            Gtk::FileChooserDialog dialog(*this, compare ? "Select Manifest" : "Save Manifest",
+                                          compare ? Gtk::FILE_CHOOSER_ACTION_OPEN : Gtk::FILE_CHOOSER_ACTION_SAVE);
+            dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+            dialog.add_button(compare ? "Open" : "Save", Gtk::RESPONSE_OK);
+            if (export_to) {
+                dialog.set_current_name("manifest.txt");
+                dialog.set_do_overwrite_confirmation(true);
+            }
+            if (dialog.run() != Gtk::RESPONSE_OK) return;
+            std::string path = dialog.get_filename();
+            if (compare) {
+                std::ifstream in(path);
+                std::string error = "cannot read file";
+                if (!in || !vp_manifest_read(in, manifest, error)) {
+                    m_status.set_text(Glib::filename_display_basename(path) + ": " + error);
+                    return;
+                }
+            } else {
+                export_path = path;
             }
         }
+
+        m_verify_progress = std::make_unique<VPVerifyProgress>();
+        m_progress.set_fraction(0.0);
+        m_progress.set_show_text(true);
+        m_progress.show();
+        m_cancel_button.show();
+        m_status.set_text("Verifying...");
+        m_verify_export_path = export_path;
+        m_verify_thread = std::thread([this, compare, manifest = std::move(manifest)]() {
+            std::vector<VPVerifyResult> results;
+            for (size_t a = 0; a < m_vfs.archive_count() && !m_verify_progress->cancel; ++a) {
+                results.push_back(vp_verify(m_vfs.archive(a), *m_verify_progress));
+                if (compare)
+                    vp_verify_compare(results.back(), manifest);
+            }
+            m_verify_results = std::move(results);
+            m_verify_done.emit();
+        });
+        m_verify_timer = Glib::signal_timeout().connect([this]() {
+            show_progress(*m_verify_progress);
+            return true;
+        }, 100);
+    }
+
+    void on_verify_finished() {
+        m_verify_thread.join();
+        m_verify_timer.disconnect();
+        m_progress.hide();
+        m_cancel_button.hide();
+
+        size_t files = 0, issues = 0;
+        uint64_t bytes = 0;
+        double seconds = 0.0;
+        bool cancelled = m_verify_progress->cancel;
+        std::ostringstream report;
+        for (const auto& r : m_verify_results) {
+            files += r.files;
+            bytes += r.bytes;
+            seconds += r.seconds;
+            issues += r.issues.size();
+            report << Glib::filename_display_basename(r.archive) << ": "
+                   << (r.issues.empty() ? "OK" : std::to_string(r.issues.size()) + " problems") << "\n";
+            for (const auto& issue : r.issues)
+                report << "    " << (issue.path.empty() ? "" : issue.path + ": ") << issue.message << "\n";
+        }
+
+        std::ostringstream msg;
+        msg << std::fixed << std::setprecision(1) << (cancelled ? "Verification cancelled: " : "Verified ") << files
+            << " files (" << bytes / (1024.0 * 1024.0) << " MB) in " << seconds << " s, "
+            << (seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0) << " MB/s, " << issues << " problems";
+        if (!m_verify_export_path.empty() && !cancelled) {
+            std::ofstream out(m_verify_export_path);
+            vp_manifest_write(out, m_verify_results);
+            msg << (out ? ", manifest saved" : ", could not write the manifest");
+        }
+        m_status.set_text(msg.str());
+        show_message(report.str());
+        m_verify_results.clear();
+    }
+
+    void on_extract_finished() {
+        m_extract_thread.join();
+        m_extract_timer.disconnect();
+        m_progress.hide();
+        m_cancel_button.hide();
+
+        const auto& r = m_extract_result;
+        std::ostringstream msg;
+        msg << std::fixed << std::setprecision(1)
+            << (r.cancelled ? "Extraction cancelled: " : "Extracted ")
+            << r.files << " files (" << r.bytes / (1024.0 * 1024.0) << " MB) in "
+            << r.seconds << " s, " << r.mb_per_sec() << " MB/s, " << r.files_per_sec() << " files/s";
+        if (r.failed > 0)
+            msg << ", " << r.failed << " failed";
+        m_status.set_text(msg.str());
+    }
+
+    // Searches every file of the open archives on a background thread. Hits
+    // arrive a file at a time through m_search_ready, so the list fills while
+    // the search runs; a new search (or opening archives) cancels the old one.
+    void on_search() {
+        stop_search();
+        m_results->clear();
+        m_search_shown = 0;
+        std::string pattern = m_search_entry.get_text();
+        if (pattern.empty() || m_vfs.archive_count() == 0) {
+            m_results_scroll.hide();
+            return;
+        }
+        m_results_scroll.show();
+        m_status.set_text("Searching for \"" + pattern + "\"...");
+
+        VPSearchOptions options;
+        options.pattern = pattern;
+        options.ignore_case = true;
+        options.regex = m_search_regex.get_active();
+        m_search_finished = false;
+        m_search_progress = std::make_unique<VPSearchProgress>();
+        m_search_thread = std::thread([this, options]() {
+            VPSearchResult result = vp_search(m_vfs, options, *m_search_progress, [this](std::vector<VPSearchHit>&& hits) {
+                bool wake;
+                {
+                    std::lock_guard<std::mutex> lock(m_search_mutex);
+                    wake = m_search_pending.empty();
+                    for (auto& hit : hits)
+                        m_search_pending.push_back(std::move(hit));
+                }
+                if (wake) m_search_ready.emit();
+            });
+            {
+                std::lock_guard<std::mutex> lock(m_search_mutex);
+                m_search_result = result;
+                m_search_finished = true;
+            }
+            m_search_ready.emit();
+        });
+    }
+
+    void stop_search() {
+        if (!m_search_thread.joinable()) return;
+        m_search_progress->cancel = true;
+        m_search_thread.join();
+        std::lock_guard<std::mutex> lock(m_search_mutex);
+        m_search_pending.clear();
+        m_search_finished = false;
+    }
+
+    void on_search_ready() {
+        // A ListStore with hundreds of thousands of rows makes the view
+        // crawl; past the cap only the count is kept.
+        const size_t max_rows = 10000;
+        if (!m_search_thread.joinable())
+            return; // a late wake-up from a search that was stopped
+        std::vector<VPSearchHit> hits;
+        bool finished;
+        VPSearchResult result;
+        {
+            std::lock_guard<std::mutex> lock(m_search_mutex);
+            hits.swap(m_search_pending);
+            finished = m_search_finished;
+            result = m_search_result;
+        }
+        for (const auto& hit : hits) {
+            if (m_search_shown++ >= max_rows) continue;
+            const auto& node = m_vfs.nodes()[hit.node];
+            Gtk::TreeModel::Row row = *(m_results->append());
+            row[m_result_columns.m_col_path] = std::string(node.full_path);
+            row[m_result_columns.m_col_line] = hit.line;
+            // Snippets are raw bytes; a ustring must be valid UTF-8.
+            Glib::ustring text = hit.snippet;
+            row[m_result_columns.m_col_text] = text.validate() ? text : Glib::convert_with_fallback(hit.snippet, "UTF-8", "ISO-8859-1");
+            row[m_result_columns.m_col_index] = static_cast<int>(hit.node);
+        }
+        if (!finished) {
+            m_status.set_text("Searching... " + std::to_string(m_search_shown) + " hits");
+            return;
+        }
+        m_search_thread.join();
+        m_search_finished = false;
+
+        std::ostringstream msg;
+        msg << std::fixed << std::setprecision(1);
+        if (!result.error.empty())
+            msg << "Search failed: " << result.error;
+        else
+            msg << result.hits << " hits in " << result.files_matched << " of " << result.files << " files ("
+                << result.bytes / (1024.0 * 1024.0) << " MB, " << result.mb_per_sec() << " MB/s)";
+        if (result.hits > max_rows)
+            msg << ", first " << max_rows << " listed";
+        m_status.set_text(msg.str());
+    }
+
+    void on_search_result_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn*) {
+        auto it = m_results->get_iter(path);
+        if (!it) return;
+        m_reveal_node = (*it)[m_result_columns.m_col_index];
+        m_reveal_line = (*it)[m_result_columns.m_col_line];
+        reveal_node(static_cast<uint32_t>(m_reveal_node));
+    }
+
+    // Expands the tree down to a VFS node and selects it, which previews it
+    // like a click would. Expanding fills in the lazily added rows on the way.
+    void reveal_node(uint32_t index) {
+        std::vector<uint32_t> chain;
+        for (int i = static_cast<int>(index); i >= 0; i = m_vfs.nodes()[i].parent)
+            chain.push_back(static_cast<uint32_t>(i));
+
+        Gtk::TreeModel::iterator row;
+        auto children = m_treestore->children();
+        for (auto step = chain.rbegin(); step != chain.rend(); ++step) {
+            row = std::find_if(children.begin(), children.end(), [&](const Gtk::TreeModel::Row& r) {
+                int i = r[m_columns.m_col_index];
+                return i == static_cast<int>(*step);
+            });
+            if (row == children.end()) return;
+            if (*step != index) {
+                m_treeview.expand_row(m_treestore->get_path(row), false);
+                children = row->children();
+            }
+        }
+        auto path = m_treestore->get_path(row);
+        m_treeview.get_selection()->unselect_all(); // reselecting the same row must still preview it
+        m_treeview.get_selection()->select(row);
+        m_treeview.scroll_to_row(path);
+    }
+
+    // Shows the images directly inside a directory as a grid. Rows start out
+    // blank and get their pixbuf as the loader delivers thumbnails, which
+    // for entries seen before come straight from the disk cache.
+    void show_thumbnails(const VPVFSNode& dir) {
+        clear_thumbnails();
+        std::vector<ThumbnailJob> jobs;
+        for (uint32_t child : dir.children) {
+            const auto& node = m_vfs.nodes()[child];
+            PreviewKind kind;
+            if (node.is_dir || !prefetch_kind(extension_of(node.name), kind) || kind == PreviewKind::Text)
+                continue;
+            VPEntry entry = m_vfs.entry(node);
+            if (entry.size <= 0) continue;
+            Gtk::TreeModel::iterator it = m_thumb_store->append();
+            (*it)[m_thumb_columns.m_col_pixbuf] = thumbnail_placeholder();
+            (*it)[m_thumb_columns.m_col_name] = std::string(node.name);
+            (*it)[m_thumb_columns.m_col_index] = static_cast<int>(child);
+            m_thumb_rows[child] = it;
+            jobs.push_back({kind, &m_vfs.archive(node), entry, child});
+        }
+        if (jobs.empty()) return;
+        m_stack.set_visible_child(m_thumb_scroll);
+        m_status.set_text("Loading " + std::to_string(jobs.size()) + " thumbnails...");
+        m_thumbs.start(std::move(jobs));
+    }
+
+    void clear_thumbnails() {
+        m_thumbs.cancel_and_wait();
+        m_thumb_rows.clear();
+        m_thumb_store->clear();
+    }
+
+    // Blank square the size of a thumbnail, so the grid doesn't reflow as
+    // thumbnails arrive.
+    Glib::RefPtr<Gdk::Pixbuf> thumbnail_placeholder() {
+        if (!m_thumb_placeholder) {
+            m_thumb_placeholder = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, m_thumbs.size(), m_thumbs.size());
+            m_thumb_placeholder->fill(0x00000000);
+        }
+        return m_thumb_placeholder;
+    }
+
+    void on_thumbnails_ready() {
+        for (auto& result : m_thumbs.take_results()) {
+            auto row = m_thumb_rows.find(result.node);
+            if (row == m_thumb_rows.end() || result.thumb.width == 0) continue;
+            const Thumbnail& thumb = result.thumb;
+            auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, thumb.width, thumb.height);
+            for (int y = 0; y < thumb.height; ++y)
+                std::memcpy(pixbuf->get_pixels() + static_cast<size_t>(pixbuf->get_rowstride()) * y,
+                            thumb.rgba.data() + static_cast<size_t>(thumb.width) * 4 * y, static_cast<size_t>(thumb.width) * 4);
+            (*row->second)[m_thumb_columns.m_col_pixbuf] = pixbuf;
+        }
+        ThumbnailStats stats;
+        if (m_thumbs.take_finished(stats)) {
+            std::ostringstream msg;
+            msg << std::fixed << std::setprecision(2) << stats.files << " thumbnails in " << stats.seconds << " s ("
+                << stats.from_disk << " from cache";
+            if (stats.failed > 0)
+                msg << ", " << stats.failed << " unreadable";
+            msg << ")";
+            m_status.set_text(msg.str());
+        }
+    }
+
+    void on_thumbnail_activated(const Gtk::TreeModel::Path& path) {
+        auto it = m_thumb_store->get_iter(path);
+        if (!it) return;
+        int index = (*it)[m_thumb_columns.m_col_index];
+        reveal_node(static_cast<uint32_t>(index));
+    }
+
+    // Preview cache budget in bytes, from VPVIEW_PREVIEW_CACHE_MB (default 256).
+    static size_t preview_cache_budget() {
+        size_t mb = 256;
+        if (const char* env = std::getenv("VPVIEW_PREVIEW_CACHE_MB"))
+            mb = std::strtoul(env, nullptr, 10);
+        return mb * 1024 * 1024;
+    }
+
+    std::string cache_stats_text() const {
+        auto s = m_preview.cache().stats();
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(1) << "Preview cache: " << s.hits << " hits, "
+             << s.misses << " misses, " << s.evictions << " evictions, " << s.items << " items, "
+             << s.bytes / (1024.0 * 1024.0) << " / " << s.budget / (1024.0 * 1024.0) << " MB";
+        return text.str();
+    }
+
+    static std::string extension_of(std::string_view name) {
+        auto ext_pos = name.find_last_of('.');
+        std::string ext = (ext_pos != std::string_view::npos) ? std::string(name.substr(ext_pos + 1)) : "";
+        for (char& c : ext)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return ext;
+    }
+
+    static bool is_text_extension(const std::string& ext) {
+        return ext == "txt" || ext == "hcf" || ext == "tbl" || ext == "fs2" || ext == "fc2";
+    }
+
+    // Previews worth decoding ahead of time. Everything else that reaches
+    // the generic image path is only tried when actually selected.
+    static bool prefetch_kind(const std::string& ext, PreviewKind& kind) {
+        if (is_text_extension(ext)) kind = PreviewKind::Text;
+        else if (ext == "pcx") kind = PreviewKind::PCX;
+        else if (ext == "dds") kind = PreviewKind::DDS;
+        else if (ext == "tga") kind = PreviewKind::TGA;
+        else if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp") kind = PreviewKind::Image;
+        else return false;
+        return true;
+    }
+
+    // DDS previews hold the mip level picked for the current target size,
+    // so a larger window must not reuse a smaller level.
+    uint64_t cache_key(PreviewKind kind, const VPVFSNode& node) {
+        return preview_key(node.ref.archive, node.ref.entry,
+                           kind == PreviewKind::DDS ? m_preview.size_class() : 0);
+    }
+
+    // Shows a cached preview at once, or hands the entry to the preview
+    // worker. The spinner page only appears if the result takes longer than
+    // a blink, so quick decodes don't flicker.
+    void request_preview(PreviewKind kind, const VPVFSNode& node) {
+        m_preview.set_target_size(m_stack.get_allocated_width(), m_stack.get_allocated_height());
+        uint64_t key = cache_key(kind, node);
+        std::shared_ptr<const PreviewResult> cached;
+        if (m_preview.cache().get(key, cached)) {
+            show_preview(cached);
+            return;
+        }
+        VPEntry entry = m_vfs.entry(node);
+        m_preview.submit(kind, m_vfs.archive(node), entry, key);
+        m_loading_label.set_text("Loading " + std::string(entry.name) + "...");
+        m_loading_timer = Glib::signal_timeout().connect([this]() {
+            m_spinner.start();
+            m_stack.set_visible_child(m_loading_box);
+            return false;
+        }, 100);
+    }
+
+    // Queues the previewable siblings just below and above the selection.
+    void prefetch_neighbours(const Gtk::TreeModel::iterator& iter) {
+        std::vector<std::tuple<PreviewKind, const VPParser*, VPEntry, uint64_t>> items;
+        auto add = [&](const Gtk::TreeModel::Path& path) {
+            auto it = m_treestore->get_iter(path);
+            if (!it) return false;
+            int index = (*it)[m_columns.m_col_index];
+            if (index < 0) return false;
+            const auto& node = m_vfs.nodes()[index];
+            PreviewKind kind;
+            if (!node.is_dir && prefetch_kind(extension_of(node.name), kind))
+                items.emplace_back(kind, &m_vfs.archive(node), m_vfs.entry(node), cache_key(kind, node));
+            return true;
+        };
+        Gtk::TreeModel::Path next = m_treestore->get_path(iter);
+        Gtk::TreeModel::Path prev = next;
+        for (int i = 0; i < 2; ++i) {
+            next.next();
+            if (!add(next)) break;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (!prev.prev() || !add(prev)) break;
+        }
+        m_preview.prefetch(std::move(items));
+    }
+
+    void on_preview_ready() {
+        if (auto result = m_preview.take_result())
+            show_preview(result);
+    }
+
+    void show_preview(const std::shared_ptr<const PreviewResult>& result) {
+        m_loading_timer.disconnect();
+        m_spinner.stop();
+        m_status.set_tooltip_text(cache_stats_text());
+
+        if (result->failed) {
+            show_message(result->text);
+        } else if (result->kind == PreviewKind::Text) {
+            show_text(result);
+        } else {
+            m_image_view.set_pixbuf(result->pixbuf);
+            m_stack.set_visible_child(m_image_view);
+        }
+    }
+
+    // Puts a message (an error, a report) on the text page, without outline.
+    void show_message(const Glib::ustring& text) {
+        stop_text_fill();
+        m_outline->clear();
+        m_outline_scroll.hide();
+        m_text_view.get_buffer()->set_text(text);
+        m_stack.set_visible_child(m_text_page);
+    }
+
+    // One set_text() of a multi-megabyte mission would stall the main loop,
+    // so the text goes in a slice at a time from an idle handler, followed
+    // by the highlighting the preview worker worked out. The outline comes
+    // from the same worker pass and is listed at once.
+    void show_text(std::shared_ptr<const PreviewResult> result) {
+        stop_text_fill();
+        m_text_view.get_buffer()->set_text("");
+        m_outline_view.unset_model();
+        m_outline->clear();
+        for (const auto& item : result->scan.outline) {
+            Gtk::TreeModel::Row row = *(m_outline->append());
+            row[m_outline_columns.m_col_label] = item.level == 0 ? item.label : "    " + item.label;
+            row[m_outline_columns.m_col_line] = item.line;
+        }
+        m_outline_view.set_model(m_outline);
+        m_outline_scroll.set_visible(!result->scan.outline.empty());
+        if (result->converted)
+            m_status.set_text("Not valid UTF-8; shown as Windows-1252");
+        m_stack.set_visible_child(m_text_page);
+
+        m_text_shown = std::move(result);
+        m_text_filled = 0;
+        m_spans_applied = 0;
+        if (on_text_fill())
+            m_text_fill = Glib::signal_idle().connect(sigc::mem_fun(*this, &VPViewerWindow::on_text_fill));
+    }
+
+    void stop_text_fill() {
+        m_text_fill.disconnect();
+        m_text_shown.reset();
+    }
+
+    // One idle slice of about 8 ms: more text while there is any left, then
+    // tags. Slices end after a newline, so every line in the buffer is whole
+    // and the spans of the lines so far can be applied. Idle handlers run
+    // below redraw and input priority, so the window stays responsive.
+    bool on_text_fill() {
+        if (!m_text_shown)
+            return false;
+        VPTraceScope trace("text fill");
+        const gint64 deadline = g_get_monotonic_time() + 8000;
+        const size_t slice = 256 * 1024;
+        auto buffer = m_text_view.get_buffer();
+        const std::string& text = m_text_shown->text;
+        const size_t start = m_text_filled;
+        while (m_text_filled < text.size() && g_get_monotonic_time() < deadline) {
+            size_t end = std::min(text.size(), m_text_filled + slice);
+            if (end < text.size()) {
+                const void* nl = std::memchr(text.data() + end, '\n', text.size() - end);
+                end = nl ? static_cast<size_t>(static_cast<const char*>(nl) - text.data()) + 1 : text.size();
+            }
+            buffer->insert(buffer->end(), text.data() + m_text_filled, text.data() + end);
+            m_text_filled = end;
+        }
+        trace.set_bytes(static_cast<int64_t>(m_text_filled - start));
+        reveal_pending_line();
+
+        const bool complete = m_text_filled == text.size();
+        const uint32_t whole_lines = complete ? m_text_shown->scan.lines : static_cast<uint32_t>(buffer->get_line_count() - 1);
+        const auto& spans = m_text_shown->scan.spans;
+        while (m_spans_applied < spans.size() && spans[m_spans_applied].line < whole_lines &&
+               g_get_monotonic_time() < deadline) {
+            for (size_t n = 0; n < 256 && m_spans_applied < spans.size() && spans[m_spans_applied].line < whole_lines;
+                 ++n, ++m_spans_applied) {
+                const TextSpan& span = spans[m_spans_applied];
+                // The scan splits lines as the buffer does; check anyway
+                // rather than let GTK warn about a bad index.
+                auto from = buffer->get_iter_at_line(static_cast<int>(span.line));
+                if (from.get_bytes_in_line() < static_cast<int>(span.column + span.length))
+                    continue;
+                from.set_line_index(static_cast<int>(span.column));
+                auto to = from;
+                to.set_line_index(static_cast<int>(span.column + span.length));
+                buffer->apply_tag(m_text_tags[static_cast<int>(span.style)], from, to);
+            }
+        }
+        if (complete && m_spans_applied == spans.size()) {
+            m_text_shown.reset();
+            return false;
+        }
+        return true;
+    }
+
+    // Selects line m_reveal_line (counted from 1) and scrolls to it, once
+    // the text being filled in has got that far.
+    void reveal_pending_line() {
+        if (m_reveal_line == 0)
+            return;
+        auto buffer = m_text_view.get_buffer();
+        bool complete = !m_text_shown || m_text_filled == m_text_shown->text.size();
+        if (!complete && static_cast<int>(m_reveal_line) >= buffer->get_line_count())
+            return;
+        auto line = buffer->get_iter_at_line(static_cast<int>(m_reveal_line) - 1);
+        auto line_end = line;
+        line_end.forward_to_line_end();
+        buffer->select_range(line, line_end);
+        m_text_view.scroll_to(buffer->get_insert(), 0.25);
+        m_reveal_line = 0;
+    }
+
+    void on_outline_selected() {
+        auto iter = m_outline_view.get_selection()->get_selected();
+        if (!iter)
+            return;
+        unsigned line = (*iter)[m_outline_columns.m_col_line];
+        m_reveal_line = line + 1;
+        reveal_pending_line();
+    }
+
+    void create_text_tags() {
+        auto table = m_text_view.get_buffer()->get_tag_table();
+        auto add = [&](TextStyle style, const char* name, const char* colour) {
+            auto tag = Gtk::TextTag::create(name);
+            tag->property_foreground() = colour;
+            table->add(tag);
+            m_text_tags[static_cast<int>(style)] = tag;
+            return tag;
+        };
+        add(TextStyle::Section, "section", "#7b2d8e")->property_weight() = Pango::WEIGHT_BOLD;
+        add(TextStyle::Field, "field", "#1c5fa8");
+        add(TextStyle::SubField, "subfield", "#2f7f8f");
+        add(TextStyle::Comment, "comment", "#6e7781")->property_style() = Pango::STYLE_ITALIC;
+        add(TextStyle::String, "string", "#a04a1c");
+        add(TextStyle::Number, "number", "#2b7a3d");
+    }
+
+    // The frame on screen is picked from the clock, not counted in ticks, so
+    // playback keeps the file's frame rate however late the timer fires.
+    // Ticking at twice that rate bounds the error to half a frame.
+    void start_animation() {
+        m_ani_start = g_get_monotonic_time();
+        m_ani_shown = -1;
+        m_ani_timer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &VPViewerWindow::on_ani_tick),
+                                                     std::max(1, 500 / m_ani.fps()));
+        if (on_ani_tick())
+            m_stack.set_visible_child(m_image_view);
+    }
+
+    bool on_ani_tick() {
+        gint64 elapsed = g_get_monotonic_time() - m_ani_start;
+        int n = static_cast<int>(elapsed * m_ani.fps() / G_USEC_PER_SEC % m_ani.frame_count());
+        if (n == m_ani_shown)
+            return true;
+        const uint8_t* pixels;
+        try {
+            pixels = m_ani.frame(n);
+            m_ani.decode_ahead(n);
+        } catch (const std::exception&) {
+            stop_animation();
+            show_message("[Invalid ANI animation]");
+            return false;
+        }
+        // Later frames keep whatever zoom and pan the first one was given.
+        m_image_view.set_rgba(pixels, m_ani.width(), m_ani.height(), m_ani.stride(), 4, m_ani_shown >= 0);
+        m_ani_shown = n;
+        return true;
+    }
+
+    void stop_animation() {
+        m_ani_timer.disconnect();
     }
 
 	void on_tree_selection_changed() {
 	    auto iter = m_treeview.get_selection()->get_selected();
 	    if (!iter) return;
 	    int index = (*iter)[m_columns.m_col_index];
-	    const auto& entry = m_parser.entries[index];
+	    if (index < 0) return;
+	    if (index != m_reveal_node)
+	        m_reveal_line = 0;
+	    const auto& node = m_vfs.nodes()[index];
+	    const auto& parser = m_vfs.archive(node);
+	    const auto& entry = m_vfs.entry(node);
+	    VPTraceScope trace("select entry");
+	    trace.set_detail(entry.full_path);
+
+	    // Whatever was loading for the previous selection is now irrelevant.
+	    m_preview.cancel();
+	    m_loading_timer.disconnect();
+	    stop_text_fill();
+	    stop_animation();
+	    m_pof_shown = false;
 	
-	    if (entry.size > 0) {
-	        m_parser.file.seekg(entry.offset);
-	        std::vector<char> buffer(entry.size);
-	        m_parser.file.read(buffer.data(), entry.size);
-		
-	        auto ext_pos = entry.name.find_last_of('.');
-	        std::string ext = (ext_pos != std::string::npos) ? entry.name.substr(ext_pos + 1) : "";
+	    if (!node.is_dir && entry.size > 0) {
+	        if (!parser.in_bounds(entry)) {
+	            show_message("[Entry lies outside the archive]");
+	            return;
+	        }
+
+	        std::string ext = extension_of(entry.name);
 	
-	        if (ext == "ani" || ext == "ANI") {
-				std::vector<uint8_t> byte_buffer(buffer.begin(), buffer.end());
-/*				ani.load_ani_from_memory(byte_buffer);
-				m_current_pixbuf = .play();
-				m_stack.set_visible_child(m_ani_widget);
-				m_ani_widget.queue_draw();*/
-	                std::cerr << "Ani not implemented yet." << std::endl;
-			} else if (ext == "txt" || ext == "hcf" || ext == "tbl" || ext == "fs2" || ext == "fc2" || ext == "TXT" || ext == "HCF" || ext == "TBL" || ext == "FS2" || ext == "FC2") {
-	            std::string content(buffer.begin(), buffer.end());
-	            m_text_view.get_buffer()->set_text(content);
-        	    m_stack.set_visible_child(m_text_scroll);
-	        } else if (ext == "pcx" || ext == "PCX") {
-				std::vector<uint8_t> byte_buffer(buffer.begin(), buffer.end());
-				pcx = load_pcx_from_memory(byte_buffer);
-				m_current_pixbuf = Gdk::Pixbuf::create_from_data(
-				    pcx.rgba_data.data(),
-				    Gdk::COLORSPACE_RGB,
-				    true,
-				    8,
-				    pcx.width,
-				    pcx.height,
-				    pcx.width * 4
-				);
-				m_stack.set_visible_child(m_drawing_area);
-				m_drawing_area.queue_draw();
-	        } else if (ext == "pof" || ext == "POF") {
-	                std::cerr << "POF 3D model viewer not implemented yet." << std::endl;
-	        } else if (ext == "wav") {
-	            gst_init(nullptr, nullptr);
-	            m_playbin = gst_element_factory_make("playbin", "player");
-	            if (!m_playbin) {
-	                std::cerr << "Failed to create playbin element." << std::endl;
-	                std::exit(1);
+	        if (ext == "ani") {
+	            VPTraceScope load_trace("ANI load");
+	            load_trace.set_bytes(entry.size);
+	            VPView data = parser.read(entry, m_scratch);
+	            try {
+	                m_ani.load(data.data, data.size);
+	                start_animation();
+	            } catch (const std::exception&) {
+	                show_message("[Invalid ANI animation]");
 	            }
-            	    // Label (spans all 4 columns)
-	            m_label.set_text("Filename:");
-	     	    m_label.set_text(entry.name);
-	            m_grid.attach(m_label, 0, 0, 4, 1); // column, row, width, height
-
-	            // Horizontal scrollbar (also 4 columns wide)
-	            m_scrollbar.set_orientation(Gtk::ORIENTATION_HORIZONTAL);
-	            m_adjustment = Gtk::Adjustment::create(0, 0, 100, 1, 10);
-	            m_scrollbar.set_adjustment(m_adjustment);
-        	    m_grid.attach(m_scrollbar, 0, 1, 4, 1);
-
-
-		    m_button_play.signal_clicked().connect([this, &entry] {
-			on_play_clicked(entry);
-		    });
-//	            m_button_play.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_play_clicked));
-	            m_button_pause.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_pause_clicked));
-	            m_button_stop.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_stop_clicked));
-	            m_button_restart.signal_clicked().connect(sigc::mem_fun(*this, &VPViewerWindow::on_restart_clicked));
-	            Glib::signal_timeout().connect(sigc::mem_fun(*this, &VPViewerWindow::on_timeout), 100); 
-	            // Buttons
-	            m_grid.attach(m_button_play, 0, 2, 1, 1);
-	            m_button_play.set_label("Play");
-
-	            m_grid.attach(m_button_pause, 1, 2, 1, 1);
-	            m_button_pause.set_label("Pause");
-
-	            m_grid.attach(m_button_stop, 2, 2, 1, 1);
-	            m_button_stop.set_label("Stop");
-
-	            m_grid.attach(m_button_restart, 3, 2, 1, 1);
-        	    m_button_restart.set_label("Restart");
-		    	m_grid.show_all_children();
+			} else if (is_text_extension(ext)) {
+	            request_preview(PreviewKind::Text, node);
+	        } else if (ext == "pcx") {
+	            request_preview(PreviewKind::PCX, node);
+	        } else if (ext == "dds") {
+	            request_preview(PreviewKind::DDS, node);
+	        } else if (ext == "tga") {
+	            request_preview(PreviewKind::TGA, node);
+	        } else if (ext == "pof") {
+	            VPTraceScope load_trace("POF load");
+	            load_trace.set_bytes(entry.size);
+	            VPView data = parser.read(entry, m_scratch);
+	            try {
+	                m_pof.load(data.data, data.size);
+	                m_pof_renderer.set_triangles(m_pof.triangles());
+	                m_pof_camera = POFCamera();
+	                m_pof_shown = true;
+	                m_stack.set_visible_child(m_model_area);
+	                m_model_area.queue_draw();
+	            } catch (const std::exception&) {
+	                show_message("[Invalid POF model]");
+	            }
+	        } else if (ext == "wav") {
+	            m_audio_selected = index;
+	            m_label.set_text(std::string(entry.name));
 	            m_stack.set_visible_child(m_grid);
 	        } else {
 	            // Try to load as image (e.g., supported format)
-	            try {
-	                auto loader = Gdk::PixbufLoader::create();
-	                loader->write(reinterpret_cast<const guint8*>(buffer.data()), buffer.size());
-	                loader->close();
-	                auto pixbuf = loader->get_pixbuf();
-	
-	                m_drawing_area.signal_draw().connect([pixbuf](const Cairo::RefPtr<Cairo::Context>& cr) {
-	                    Gdk::Cairo::set_source_pixbuf(cr, pixbuf, 0, 0);
-	                    cr->paint();
-                    return true;
-	                }, false);
-	                m_stack.set_visible_child(m_drawing_area);
-	                m_drawing_area.queue_draw();
-	            } catch (...) {
-	                m_text_view.get_buffer()->set_text("[Unknown binary or unsupported format]");
-	                m_stack.set_visible_child(m_text_scroll);
-	            }
+	            request_preview(PreviewKind::Image, node);
 	        }
+	        prefetch_neighbours(iter);
+	    } else if (node.is_dir) {
+	        show_thumbnails(node);
 	    }
 	}
 };
 
 int main(int argc, char* argv[]) {
-    auto app = Gtk::Application::create(argc, argv, "org.example.vpviewer");
-    VPViewerWindow window;
-    return app->run(window);
+    vp_trace_init(argc, argv);
+    int status;
+    if (argc > 1 && vp_cli_is_command(argv[1])) {
+        status = vp_cli_main(argc, argv);
+    } else {
+        gst_init(&argc, &argv);
+        auto app = Gtk::Application::create(argc, argv, "org.example.vpviewer");
+        // The window joins its worker threads on destruction, so every
+        // traced thread is done before the trace is written.
+        VPViewerWindow window;
+        status = app->run(window);
+    }
+    vp_trace_finish();
+    return status;
 }
@@ -0,0 +1,515 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <strings.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vp_parser.h"
+#include "vp_trace.h"
+#include "vp_verify.h"
+
+struct VPWriteOptions {
+    bool dedupe = true;         // store identical payloads once
+    unsigned threads = 0;       // input readers; 0 picks one per core, up to 8
+    size_t chunk = 4u << 20;    // output write size
+    size_t read_ahead = 64u << 20; // payload bytes read but not yet written
+};
+
+struct VPWriteResult {
+    size_t files = 0;
+    size_t deduped = 0;      // files stored as a reference to an earlier payload
+    size_t skipped = 0;      // empty files; VP can't tell them from directories
+    uint64_t bytes_in = 0;   // payload bytes of all files
+    uint64_t bytes_saved = 0;
+    uint64_t file_size = 0;  // of the archive written
+    double seconds = 0.0;
+    std::string error;
+
+    bool ok() const { return error.empty(); }
+    double mb_per_sec() const { return seconds > 0 ? bytes_in / (1024.0 * 1024.0) / seconds : 0.0; }
+};
+
+// Builds a VP archive: the directory table is described first, with
+// begin_dir()/end_dir() around each directory's contents (or all at once
+// with add_tree() or add_archive()), then write() produces the file.
+//
+// Payloads are laid out in table order, so a directory's files sit
+// together as in the game's own VPs. Input files are read by a pool of
+// threads up to read_ahead bytes ahead of the single writer, which appends
+// them to a chunk-sized buffer; the header is the first 16 bytes of that
+// buffer, so every write() lands on a chunk boundary. Files larger than a
+// chunk are not buffered whole but streamed through by the writer.
+//
+// With dedupe, each payload's XXH64 and size are looked up among those
+// already written; a candidate is compared byte for byte against the
+// output before the entry is pointed at it.
+class VPWriter {
+public:
+    // Where a file's bytes come from: a file on disk, or a range of an open
+    // archive (for repacking).
+    struct Source {
+        std::string path;
+        const VPParser* parser = nullptr;
+        int64_t offset = 0;
+        int64_t size = 0;
+        int32_t timestamp = 0;
+    };
+
+    void begin_dir(std::string name) {
+        m_records.push_back({Record::Dir, std::move(name), {}});
+        ++m_depth;
+    }
+
+    void end_dir() {
+        if (m_depth == 0) return;
+        m_records.push_back({Record::Up, "..", {}});
+        --m_depth;
+    }
+
+    void add_file(std::string name, Source source) {
+        m_records.push_back({Record::File, std::move(name), std::move(source)});
+    }
+
+    // Adds the contents of `root` (not `root` itself), files before
+    // subdirectories, each sorted by name. Symbolic links are not followed,
+    // so a link loop cannot recurse and nothing outside the tree is packed;
+    // they are listed in skipped_links() instead.
+    bool add_tree(const std::string& root, std::string& error) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        std::vector<fs::directory_entry> files, dirs;
+        for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+            fs::file_status status = it->symlink_status(ec);
+            if (ec) break;
+            if (fs::is_symlink(status)) m_skipped_links.push_back(it->path().string());
+            else if (fs::is_directory(status)) dirs.push_back(*it);
+            else if (fs::is_regular_file(status)) files.push_back(*it);
+        }
+        if (ec) {
+            error = root + ": " + ec.message();
+            return false;
+        }
+        auto by_name = [](const fs::directory_entry& a, const fs::directory_entry& b) {
+            return strcasecmp(a.path().filename().c_str(), b.path().filename().c_str()) < 0;
+        };
+        std::sort(files.begin(), files.end(), by_name);
+        std::sort(dirs.begin(), dirs.end(), by_name);
+        for (const auto& f : files) {
+            struct stat st;
+            if (::lstat(f.path().c_str(), &st) != 0) {
+                error = f.path().string() + ": " + std::strerror(errno);
+                return false;
+            }
+            Source source;
+            source.path = f.path().string();
+            source.size = st.st_size;
+            source.timestamp = static_cast<int32_t>(st.st_mtime);
+            add_file(f.path().filename().string(), std::move(source));
+        }
+        for (const auto& d : dirs) {
+            begin_dir(d.path().filename().string());
+            if (!add_tree(d.path().string(), error)) return false;
+            end_dir();
+        }
+        return true;
+    }
+
+    // Symbolic links add_tree() left out, as full paths.
+    const std::vector<std::string>& skipped_links() const { return m_skipped_links; }
+
+    // Copies the directory table of an open archive; the parser has to stay
+    // loaded until write() returns.
+    void add_archive(const VPParser& parser) {
+        std::vector<int32_t> open_dirs;
+        for (size_t i = 0; i < parser.entries.size(); ++i) {
+            VPEntry entry = parser.entries[i];
+            int32_t parent = parser.entries.parents[i];
+            while (!open_dirs.empty() && open_dirs.back() != parent) {
+                open_dirs.pop_back();
+                end_dir();
+            }
+            if (entry.is_dir) {
+                begin_dir(std::string(entry.name));
+                open_dirs.push_back(static_cast<int32_t>(i));
+            } else {
+                add_file(std::string(entry.name), {"", &parser, entry.offset, entry.size, entry.timestamp});
+            }
+        }
+        for (; !open_dirs.empty(); open_dirs.pop_back())
+            end_dir();
+    }
+
+    size_t record_count() const { return m_records.size(); }
+
+    // Writes the archive to `path` through a temporary file that replaces
+    // it only on success, so `path` may be the archive being repacked.
+    VPWriteResult write(const std::string& path, const VPWriteOptions& options = {}) {
+        auto start = std::chrono::steady_clock::now();
+        VPTraceScope trace("VPWriter::write");
+        trace.set_detail(path);
+        VPWriteResult result;
+        for (; m_depth > 0;)
+            end_dir();
+        // A zero-size record reads back as a directory, so empty files can't
+        // be stored at all.
+        auto empty = std::remove_if(m_records.begin(), m_records.end(), [](const Record& r) {
+            return r.kind == Record::File && r.source.size <= 0;
+        });
+        result.skipped = static_cast<size_t>(m_records.end() - empty);
+        m_records.erase(empty, m_records.end());
+
+        std::vector<size_t> files; // record indices, in table order
+        for (size_t i = 0; i < m_records.size(); ++i) {
+            const Record& r = m_records[i];
+            if (r.name.empty() || r.name.size() > 31 || r.name.find('/') != std::string::npos) {
+                result.error = "invalid entry name '" + r.name + "' (1 to 31 characters, no '/')";
+                return result;
+            }
+            if (r.kind != Record::File) continue;
+            files.push_back(i);
+            result.bytes_in += static_cast<uint64_t>(r.source.size);
+        }
+
+        std::string tmp = path + ".tmp";
+        m_out = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_out < 0) {
+            result.error = tmp + ": " + std::strerror(errno);
+            return result;
+        }
+        m_chunk = std::max<size_t>(options.chunk, 4096);
+        m_buf.clear();
+        m_buf.reserve(m_chunk);
+        m_buf.resize(16); // header, filled in last
+        m_flushed = 0;
+        m_write_error = false;
+        m_payloads.clear();
+
+        Pipeline pipe(files.size());
+        unsigned threads = options.threads;
+        if (threads == 0)
+            threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, files.size())));
+        std::vector<std::thread> readers;
+        for (unsigned t = 0; t < threads; ++t)
+            readers.emplace_back([&]() { read_ahead(files, pipe, options); });
+
+        std::string error;
+        std::vector<uint8_t> scratch, scratch2;
+        for (size_t k = 0; k < files.size() && error.empty(); ++k) {
+            Record& record = m_records[files[k]];
+            Slot slot;
+            {
+                std::unique_lock<std::mutex> lock(pipe.mutex);
+                pipe.wake.wait(lock, [&]() { return pipe.slots[k].state != Slot::Pending; });
+                slot = std::move(pipe.slots[k]);
+            }
+            if (slot.state == Slot::Failed) {
+                error = source_name(record) + ": cannot read";
+            } else if (!place(record, slot.state == Slot::Ready ? &slot.data : nullptr, options.dedupe, scratch,
+                              scratch2)) {
+                error = m_write_error ? tmp + ": write failed" : source_name(record) + ": cannot read";
+            } else {
+                ++result.files;
+                if (record.deduped) {
+                    ++result.deduped;
+                    result.bytes_saved += static_cast<uint64_t>(record.source.size);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(pipe.mutex);
+                pipe.in_flight -= slot.data.size();
+                pipe.next_write = k + 1;
+                if (!error.empty()) pipe.abort = true;
+            }
+            pipe.wake.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(pipe.mutex);
+            pipe.abort = true;
+        }
+        pipe.wake.notify_all();
+        for (auto& t : readers)
+            t.join();
+
+        uint64_t dir_offset = position();
+        if (error.empty() && dir_offset + m_records.size() * 44 > static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+            error = "archive would exceed 2 GiB, the limit of the VP format";
+        if (error.empty()) {
+            write_directory();
+            flush(true);
+            uint8_t header[16];
+            std::memcpy(header, "VPVP", 4);
+            int32_t fields[3] = {2, static_cast<int32_t>(dir_offset), static_cast<int32_t>(m_records.size())};
+            std::memcpy(header + 4, fields, sizeof(fields));
+            if (m_write_error || pwrite(m_out, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+                error = tmp + ": write failed";
+        }
+        result.file_size = position();
+        if (::close(m_out) != 0 && error.empty())
+            error = tmp + ": write failed";
+        m_out = -1;
+        if (error.empty() && std::rename(tmp.c_str(), path.c_str()) != 0)
+            error = path + ": " + std::strerror(errno);
+        if (!error.empty())
+            std::remove(tmp.c_str());
+        result.error = error;
+        trace.set_bytes(static_cast<int64_t>(result.file_size));
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    struct Record {
+        enum Kind { Dir, File, Up } kind;
+        std::string name;
+        Source source;
+        int64_t offset = 0; // in the output, once written
+        bool deduped = false;
+    };
+
+    struct Slot {
+        enum State { Pending, Ready, Stream, Failed } state = Pending;
+        std::vector<uint8_t> data; // Ready only
+    };
+
+    struct Pipeline {
+        explicit Pipeline(size_t n) : slots(n) {}
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<Slot> slots;
+        size_t next_claim = 0;
+        size_t next_write = 0;
+        size_t in_flight = 0;
+        bool abort = false;
+    };
+
+    static std::string source_name(const Record& record) {
+        return record.source.parser ? record.source.parser->filename + ":" + record.name : record.source.path;
+    }
+
+    // Reads `size` bytes at `offset` of the source into `dst`.
+    static bool read_source(const Source& source, int fd, int64_t offset, uint8_t* dst, size_t size) {
+        int64_t base = source.parser ? source.offset : 0;
+        for (size_t done = 0; done < size;) {
+            ssize_t n = pread(fd, dst + done, size - done, static_cast<off_t>(base + offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    static int open_source(const Source& source) {
+        if (source.parser) {
+            bool in_bounds = source.offset >= 0 && source.size >= 0 &&
+                             static_cast<uint64_t>(source.offset + source.size) <= source.parser->file_size();
+            return in_bounds ? source.parser->fd() : -1;
+        }
+        return ::open(source.path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    static void close_source(const Source& source, int fd) {
+        if (!source.parser && fd >= 0) ::close(fd);
+    }
+
+    // Reader threads: claim files in table order and read them whole, as
+    // long as they stay within read_ahead bytes of the writer. The file the
+    // writer is waiting for is always let through, so one large file can't
+    // stall the pipeline.
+    void read_ahead(const std::vector<size_t>& files, Pipeline& pipe, const VPWriteOptions& options) {
+        for (;;) {
+            size_t k;
+            size_t size;
+            {
+                std::unique_lock<std::mutex> lock(pipe.mutex);
+                if (pipe.abort || pipe.next_claim >= files.size()) return;
+                k = pipe.next_claim++;
+                const Source& source = m_records[files[k]].source;
+                size = static_cast<size_t>(source.size);
+                if (size > m_chunk) {
+                    pipe.slots[k].state = Slot::Stream;
+                    pipe.wake.notify_all();
+                    continue;
+                }
+                pipe.wake.wait(lock, [&]() {
+                    return pipe.abort || k == pipe.next_write || pipe.in_flight + size <= options.read_ahead;
+                });
+                if (pipe.abort) return;
+                pipe.in_flight += size;
+            }
+            const Source& source = m_records[files[k]].source;
+            std::vector<uint8_t> data(size);
+            int fd = open_source(source);
+            bool ok = fd >= 0 && read_source(source, fd, 0, data.data(), size);
+            close_source(source, fd);
+            {
+                std::lock_guard<std::mutex> lock(pipe.mutex);
+                pipe.slots[k].state = ok ? Slot::Ready : Slot::Failed;
+                pipe.slots[k].data = std::move(data);
+            }
+            pipe.wake.notify_all();
+        }
+    }
+
+    uint64_t position() const { return m_flushed + m_buf.size(); }
+
+    // Writes out the buffer once it holds a whole chunk, or whatever it
+    // holds with `all`.
+    void flush(bool all) {
+        if (m_buf.empty() || (!all && m_buf.size() < m_chunk)) return;
+        for (size_t done = 0; done < m_buf.size();) {
+            ssize_t n = ::write(m_out, m_buf.data() + done, m_buf.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                m_write_error = true;
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+        m_flushed += m_buf.size();
+        m_buf.clear();
+    }
+
+    void append(const uint8_t* p, size_t n) {
+        while (n > 0) {
+            size_t take = std::min(n, m_chunk - m_buf.size());
+            m_buf.insert(m_buf.end(), p, p + take);
+            p += take;
+            n -= take;
+            flush(false);
+        }
+    }
+
+    // Compares `n` bytes against the output at `offset`, whether they are
+    // still buffered or already written.
+    bool output_equals(uint64_t offset, const uint8_t* p, size_t n, std::vector<uint8_t>& tmp) const {
+        if (offset < m_flushed) {
+            size_t on_disk = static_cast<size_t>(std::min<uint64_t>(n, m_flushed - offset));
+            tmp.resize(on_disk);
+            if (pread(m_out, tmp.data(), on_disk, static_cast<off_t>(offset)) != static_cast<ssize_t>(on_disk) ||
+                std::memcmp(tmp.data(), p, on_disk) != 0)
+                return false;
+            offset += on_disk;
+            p += on_disk;
+            n -= on_disk;
+        }
+        return n == 0 || std::memcmp(m_buf.data() + (offset - m_flushed), p, n) == 0;
+    }
+
+    // Appends one file's payload (from `data`, or streamed from its source
+    // when null), or points the record at an identical earlier payload.
+    bool place(Record& record, const std::vector<uint8_t>* data, bool dedupe, std::vector<uint8_t>& scratch,
+               std::vector<uint8_t>& tmp) {
+        const Source& source = record.source;
+        const size_t size = static_cast<size_t>(source.size);
+        int fd = -1;
+        if (!data) {
+            fd = open_source(source);
+            if (fd < 0) return false;
+            scratch.resize(std::min(size, m_chunk));
+        }
+        struct Closer {
+            const Source& source;
+            int fd;
+            ~Closer() { close_source(source, fd); }
+        } closer{source, fd};
+
+        uint64_t hash = 0;
+        if (dedupe) {
+            XXH64 h;
+            if (data) {
+                h.update(data->data(), size);
+            } else {
+                for (size_t at = 0; at < size; at += scratch.size()) {
+                    size_t n = std::min(scratch.size(), size - at);
+                    if (!read_source(source, fd, static_cast<int64_t>(at), scratch.data(), n)) return false;
+                    h.update(scratch.data(), n);
+                }
+            }
+            hash = h.digest() ^ (static_cast<uint64_t>(size) * 0x9E3779B97F4A7C15ull);
+            auto range = m_payloads.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second.size != size) continue;
+                bool same = true;
+                if (data) {
+                    same = output_equals(it->second.offset, data->data(), size, tmp);
+                } else {
+                    for (size_t at = 0; at < size && same; at += scratch.size()) {
+                        size_t n = std::min(scratch.size(), size - at);
+                        if (!read_source(source, fd, static_cast<int64_t>(at), scratch.data(), n)) return false;
+                        same = output_equals(it->second.offset + at, scratch.data(), n, tmp);
+                    }
+                }
+                if (same) {
+                    record.offset = static_cast<int64_t>(it->second.offset);
+                    record.deduped = true;
+                    return true;
+                }
+            }
+        }
+
+        record.offset = static_cast<int64_t>(position());
+        if (data) {
+            append(data->data(), size);
+        } else {
+            for (size_t at = 0; at < size; at += scratch.size()) {
+                size_t n = std::min(scratch.size(), size - at);
+                if (!read_source(source, fd, static_cast<int64_t>(at), scratch.data(), n)) return false;
+                append(scratch.data(), n);
+            }
+        }
+        if (dedupe)
+            m_payloads.emplace(hash, Payload{static_cast<uint64_t>(record.offset), size});
+        return !m_write_error;
+    }
+
+    // Directory records get the offset of the next file after them, as the
+    // game's own archives do; ".." records are all zero.
+    void write_directory() {
+        int64_t next_offset = static_cast<int64_t>(position());
+        for (size_t i = m_records.size(); i-- > 0;) {
+            Record& r = m_records[i];
+            if (r.kind == Record::File) next_offset = r.offset;
+            else if (r.kind == Record::Dir) r.offset = next_offset;
+        }
+        for (const Record& r : m_records) {
+            uint8_t rec[44] = {};
+            int32_t offset = r.kind == Record::Up ? 0 : static_cast<int32_t>(r.offset);
+            int32_t size = r.kind == Record::File ? static_cast<int32_t>(r.source.size) : 0;
+            int32_t timestamp = r.kind == Record::File ? r.source.timestamp : 0;
+            std::memcpy(rec, &offset, 4);
+            std::memcpy(rec + 4, &size, 4);
+            std::memcpy(rec + 8, r.name.data(), r.name.size());
+            std::memcpy(rec + 40, &timestamp, 4);
+            append(rec, sizeof(rec));
+        }
+    }
+
+    struct Payload {
+        uint64_t offset;
+        size_t size;
+    };
+
+    std::vector<Record> m_records;
+    size_t m_depth = 0;
+    std::vector<std::string> m_skipped_links;
+    int m_out = -1;
+    size_t m_chunk = 4u << 20;
+    std::vector<uint8_t> m_buf;
+    uint64_t m_flushed = 0;
+    bool m_write_error = false;
+    std::unordered_multimap<uint64_t, Payload> m_payloads; // XXH64 (mixed with size) -> written payload
+};